@@ -0,0 +1,148 @@
+#include "bitboard.hpp"
+#include "bitboard_batch.hpp"
+#include "stats.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * Batch bitboard benchmark
+ * Compares the batched move generation, flip and count functions against a
+ * loop over the single board functions, on positions from random games, and
+ * checks that both give the same results. */
+
+#define BATCH_BENCH_DEFAULT_BOARDS 65536
+#define BATCH_BENCH_DEFAULT_ROUNDS 200
+
+/* play a random game from the start position, and pick one of its positions
+ * (with the player to move first) that has a legal move */
+static bool batch_bench_position(bitboard_t *player, bitboard_t *opponent) {
+  board_t board;
+  memset(&board, 0, sizeof(board));
+  board_set_cell(&board, xy_to_move(3, 3), 0);
+  board_set_cell(&board, xy_to_move(4, 4), 0);
+  board_set_cell(&board, xy_to_move(3, 4), 1);
+  board_set_cell(&board, xy_to_move(4, 3), 1);
+
+  color_t color = 0;
+  int plies = rand() % 58;
+  for (int i = 0; i < plies; i++) {
+    auto moves = board_gen_moves(&board, color);
+    if (!moves) {
+      color = !color;
+      moves = board_gen_moves(&board, color);
+      if (!moves)
+        return false;
+    }
+    for (int skip = rand() % bits_popcount(moves); skip > 0; skip--)
+      bitboard_get_and_clear_first_move(&moves);
+    board_make_move(&board, bitboard_get_and_clear_first_move(&moves), color);
+    color = !color;
+  }
+  if (!board_gen_moves(&board, color))
+    return false;
+
+  *player = board.players[color];
+  *opponent = board.players[!color];
+  return true;
+}
+
+/* run fn rounds times, and return the boards processed per second */
+template <typename F>
+static double batch_bench_time(int boards, int rounds, F fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    fn();
+  double time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  return (double)boards * rounds / time;
+}
+
+static void batch_bench_print(const char *name, double single, double batched) {
+  printf("%-10s  ", name);
+  pprint_num(single);
+  printf("/s  ");
+  pprint_num(batched);
+  printf("/s  %6.2lfx\n", batched / single);
+}
+
+int main(int argc, char **argv) {
+  int boards = argc > 1 ? (int)strtol(argv[1], nullptr, 10)
+                        : BATCH_BENCH_DEFAULT_BOARDS;
+  int rounds = argc > 2 ? (int)strtol(argv[2], nullptr, 10)
+                        : BATCH_BENCH_DEFAULT_ROUNDS;
+  if (boards < 1 || rounds < 1) {
+    printf("Usage: %s [BOARDS] [ROUNDS]\n", argv[0]);
+    return 1;
+  }
+
+  srand(0);
+  std::vector<bitboard_t> players(boards), opponents(boards);
+  std::vector<move_t> moves(boards);
+  for (int i = 0; i < boards; i++) {
+    while (!batch_bench_position(&players[i], &opponents[i])) {
+    }
+    // one of the legal moves, for the flips
+    board_t board = {{players[i], opponents[i]}};
+    bitboard_t legal = board_gen_moves(&board, 0);
+    for (int skip = rand() % bits_popcount(legal); skip > 0; skip--)
+      bitboard_get_and_clear_first_move(&legal);
+    moves[i] = bitboard_get_and_clear_first_move(&legal);
+  }
+  board_batch_t batch = {players.data(), opponents.data(), boards};
+
+  std::vector<bitboard_t> single_out(boards), batch_out(boards);
+  std::vector<int32_t> single_counts(2 * boards), batch_counts(2 * boards);
+  bool mismatch = false;
+
+  printf("%i boards, %i rounds\n", boards, rounds);
+  printf("            single          batch\n");
+
+  double single = batch_bench_time(boards, rounds, [&]() {
+    for (int i = 0; i < boards; i++) {
+      board_t board = {{players[i], opponents[i]}};
+      single_out[i] = board_gen_moves(&board, 0);
+    }
+  });
+  double batched = batch_bench_time(boards, rounds, [&]() {
+    board_batch_gen_moves(&batch, batch_out.data());
+  });
+  batch_bench_print("Moves", single, batched);
+  mismatch |= single_out != batch_out;
+
+  single = batch_bench_time(boards, rounds, [&]() {
+    for (int i = 0; i < boards; i++) {
+      board_t board = {{players[i], opponents[i]}};
+      single_out[i] = board_gen_flips(&board, moves[i], 0);
+    }
+  });
+  batched = batch_bench_time(boards, rounds, [&]() {
+    board_batch_gen_flips(&batch, moves.data(), batch_out.data());
+  });
+  batch_bench_print("Flips", single, batched);
+  mismatch |= single_out != batch_out;
+
+  single = batch_bench_time(boards, rounds, [&]() {
+    for (int i = 0; i < boards; i++) {
+      board_t board = {{players[i], opponents[i]}};
+      single_counts[i] = bits_popcount(board_gen_moves(&board, 0));
+      single_counts[boards + i] =
+          bits_popcount(board_gen_frontiers(&board, 0));
+    }
+  });
+  batched = batch_bench_time(boards, rounds, [&]() {
+    board_batch_counts(&batch, batch_counts.data(),
+                       batch_counts.data() + boards);
+  });
+  batch_bench_print("Counts", single, batched);
+  mismatch |= single_counts != batch_counts;
+
+  if (mismatch) {
+    printf("\nBatched results differ from the single board functions\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,442 @@
+#include "bitboard.hpp"
+#include "cpu.hpp"
+#include "endgame.hpp"
+#include "evaluator.hpp"
+#include "hash_table.hpp"
+#include "minimax.hpp"
+#include "nnue.hpp"
+#include "pattern.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Microbenchmarks
+ * Times the bitboard, hashing and evaluation functions, and fixed depth
+ * searches, on a pinned set of positions (and the positions one and two moves
+ * after them). Every benchmark runs a few unrecorded warm-up repetitions, then
+ * the recorded ones, and reports the min / median / mean / standard deviation
+ * of the time per operation over the recorded repetitions. With --json, the
+ * results are also written as json, so runs can be compared across commits and
+ * machines. */
+
+#define BENCH_DEFAULT_REPS 10
+#define BENCH_DEFAULT_WARMUP 2
+#define BENCH_DEFAULT_DEPTH 8
+// operations per repetition of the microbenchmarks
+#define BENCH_OPS 1000000
+
+/* pieces of the player to move, then of the opponent */
+static const bitboard_t bench_positions[][2] = {
+    {0x0000040010780400ULL, 0x0000181808000000ULL}, /* 52 empties */
+    {0x0020402c0c0c1020ULL, 0x0010141050100000ULL}, /* 46 empties */
+    {0x200000285c1a0000ULL, 0x1c3c1c1420400000ULL}, /* 40 empties */
+    {0x101c58340010280cULL, 0x000205097f0c0010ULL}, /* 34 empties */
+    {0x100f18343a960d00ULL, 0x40a0458a44281020ULL}, /* 28 empties */
+    {0x20607ec428001848ULL, 0x108e003a56fe6300ULL}, /* 22 empties */
+    {0x58f8e0fd0890c000ULL, 0x20001e02f76c3e25ULL}, /* 16 empties */
+    {0x03860b021150fa83ULL, 0x7c7874fc6cac043cULL}, /* 10 empties */
+};
+#define BENCH_POSITIONS                                                        \
+  (int)(sizeof(bench_positions) / sizeof(bench_positions[0]))
+
+typedef struct {
+  std::string name;
+  // operations timed per repetition
+  int64_t ops;
+  // time per operation (ns) of each recorded repetition
+  std::vector<double> samples;
+  double min, median, mean, stddev;
+  // boards visited per repetition (searches only)
+  int64_t nodes;
+} bench_result_t;
+
+typedef struct {
+  int reps;
+  int warmup;
+  int depth;
+  const char *json;
+} bench_config_t;
+
+// results are folded into this, so the timed calls aren't optimized away
+static volatile uint64_t bench_sink;
+
+static void bench_summarize(bench_result_t *result) {
+  std::vector<double> sorted = result->samples;
+  std::sort(sorted.begin(), sorted.end());
+  size_t n = sorted.size();
+  result->min = sorted[0];
+  result->median =
+      n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+  double sum = 0.0;
+  for (double sample : sorted)
+    sum += sample;
+  result->mean = sum / n;
+  double sq = 0.0;
+  for (double sample : sorted)
+    sq += (sample - result->mean) * (sample - result->mean);
+  result->stddev = n > 1 ? sqrt(sq / (n - 1)) : 0.0;
+}
+
+/* time fn (which runs ops operations) over the warm-up and recorded
+ * repetitions, calling setup (untimed) before each of them */
+template <typename S, typename F>
+static bench_result_t bench_run(const bench_config_t *config,
+                                const std::string &name, int64_t ops, S setup,
+                                F fn) {
+  bench_result_t result;
+  result.name = name;
+  result.ops = ops;
+  result.nodes = 0;
+  for (int rep = 0; rep < config->warmup + config->reps; rep++) {
+    setup();
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    if (rep >= config->warmup)
+      result.samples.push_back(ns / ops);
+  }
+  bench_summarize(&result);
+
+  printf("%-22s %14.2lf %14.2lf %14.2lf %12.2lf  ", name.c_str(), result.min,
+         result.median, result.mean, result.stddev);
+  pprint_num(1e9 / result.median);
+  printf("/s\n");
+  return result;
+}
+
+template <typename F>
+static bench_result_t bench_run(const bench_config_t *config,
+                                const std::string &name, int64_t ops, F fn) {
+  return bench_run(config, name, ops, []() {}, fn);
+}
+
+/* the pinned positions, and every position one and two moves after them
+ * (always with the player to move as player 0) */
+static std::vector<board_t> bench_boards() {
+  std::vector<board_t> boards;
+  for (int p = 0; p < BENCH_POSITIONS; p++) {
+    board_t board;
+    board.players[0] = bench_positions[p][0];
+    board.players[1] = bench_positions[p][1];
+    boards.push_back(board);
+  }
+  for (int ply = 0; ply < 2; ply++) {
+    size_t parents = boards.size();
+    for (size_t i = 0; i < parents; i++) {
+      auto moves = board_gen_moves(&boards[i], 0);
+      while (moves) {
+        board_t child = boards[i];
+        board_make_move(&child, bitboard_get_and_clear_first_move(&moves), 0);
+        std::swap(child.players[0], child.players[1]);
+        if (board_gen_moves(&child, 0))
+          boards.push_back(child);
+      }
+    }
+  }
+  return boards;
+}
+
+static void bench_write_json(const bench_config_t *config,
+                             const std::vector<bench_result_t> &results) {
+  FILE *file = fopen(config->json, "w");
+  if (file == nullptr) {
+    printf("Could not open %s\n", config->json);
+    exit(1);
+  }
+
+  fprintf(file, "{\n  \"machine\": {\n");
+  fprintf(file, "    \"compiler\": \"%s\",\n", __VERSION__);
+#ifdef __AVX2__
+  fprintf(file, "    \"avx2\": true,\n");
+#else
+  fprintf(file, "    \"avx2\": false,\n");
+#endif
+#ifdef __AVX512F__
+  fprintf(file, "    \"avx512\": true,\n");
+#else
+  fprintf(file, "    \"avx512\": false,\n");
+#endif
+  fprintf(file, "    \"kernels\": \"%s\",\n",
+          cpu_variant_names[cpu_selected()]);
+  fprintf(file, "    \"hardware_threads\": %u\n  },\n",
+          std::thread::hardware_concurrency());
+  fprintf(file,
+          "  \"config\": {\"reps\": %i, \"warmup\": %i, \"depth\": %i, "
+          "\"positions\": %i},\n",
+          config->reps, config->warmup, config->depth, BENCH_POSITIONS);
+  fprintf(file, "  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const bench_result_t *result = &results[i];
+    fprintf(file,
+            "    {\"name\": \"%s\", \"ops\": %li, \"unit\": \"ns/op\", "
+            "\"min\": %.3lf, \"median\": %.3lf, \"mean\": %.3lf, "
+            "\"stddev\": %.3lf, \"samples\": [",
+            result->name.c_str(), result->ops, result->min, result->median,
+            result->mean, result->stddev);
+    for (size_t s = 0; s < result->samples.size(); s++)
+      fprintf(file, "%s%.3lf", s ? ", " : "", result->samples[s]);
+    fprintf(file, "]");
+    if (result->nodes > 0) {
+      fprintf(file, ", \"nodes\": %li, \"nodes_per_second\": %.0lf",
+              result->nodes,
+              result->nodes / (result->median * result->ops / 1e9));
+    }
+    fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+}
+
+static void print_usage(const char *name) {
+  printf("Usage: %s [--reps N] [--warmup N] [--depth D] [--json FILE] "
+         "[--cpu baseline|popcnt-bmi2|avx2|avx512]\n",
+         name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  bench_config_t config = {BENCH_DEFAULT_REPS, BENCH_DEFAULT_WARMUP,
+                           BENCH_DEFAULT_DEPTH, nullptr};
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) {
+      config.reps = (int)strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      config.warmup = (int)strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+      config.depth = (int)strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      config.json = argv[++i];
+    } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+      cpu_variant_t variant;
+      if (!cpu_variant_parse(argv[++i], &variant) || !cpu_supports(variant))
+        print_usage(argv[0]);
+      cpu_select(variant);
+    } else {
+      print_usage(argv[0]);
+    }
+  }
+  if (config.reps < 1 || config.warmup < 0 || config.depth < 1)
+    print_usage(argv[0]);
+
+  hash_table_t hash_table;
+  if (!hash_table_alloc(&hash_table, HASH_TABLE_DEFAULT_MB)) {
+    printf("Could not allocate the transposition table\n");
+    return 1;
+  }
+
+  std::vector<board_t> boards = bench_boards();
+  const int num_boards = (int)boards.size();
+  // a legal move on each board (and the pieces it flips), each board's moves
+  // for both players, and each board's hash
+  std::vector<move_t> moves(num_boards);
+  std::vector<bitboard_t> flips(num_boards);
+  std::vector<bitboard_t> moves0(num_boards), moves1(num_boards);
+  std::vector<uint64_t> hashes(num_boards);
+  for (int i = 0; i < num_boards; i++) {
+    moves0[i] = board_gen_moves(&boards[i], 0);
+    moves1[i] = board_gen_moves(&boards[i], 1);
+    moves[i] = bits_index_of_first_set(moves0[i]);
+    flips[i] = board_gen_flips(&boards[i], moves[i], 0);
+    hashes[i] = hash_board(&boards[i], 0);
+  }
+
+  printf("%i boards, %i repetitions (+%i warm-up), %s kernels\n\n",
+         num_boards, config.reps, config.warmup,
+         cpu_variant_names[cpu_selected()]);
+  printf("%-22s %14s %14s %14s %12s\n", "Benchmark (ns/op)", "Min", "Median",
+         "Mean", "Stddev");
+
+  std::vector<bench_result_t> results;
+  results.push_back(
+      bench_run(&config, "board_gen_moves", BENCH_OPS, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++)
+          sum += board_gen_moves(&boards[i % num_boards], i & 1);
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(
+      bench_run(&config, "board_make_move", BENCH_OPS, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          board_t board = boards[i % num_boards];
+          board_make_move(&board, moves[i % num_boards], 0);
+          sum += board.players[0];
+        }
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(
+      bench_run(&config, "board_gen_frontiers", BENCH_OPS, [&]() {
+        uint64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++)
+          sum += board_gen_frontiers(&boards[i % num_boards], i & 1);
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(
+      bench_run(&config, "board_gen_features", BENCH_OPS, [&]() {
+        uint64_t sum = 0;
+        board_features_t features;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          board_gen_features(&boards[i % num_boards], &features);
+          sum += features.moves[0] + features.frontiers[1];
+        }
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(bench_run(&config, "hash_board", BENCH_OPS, [&]() {
+    uint64_t sum = 0;
+    for (int i = 0; i < BENCH_OPS; i++)
+      sum += hash_board(&boards[i % num_boards], i & 1);
+    bench_sink = bench_sink + sum;
+  }));
+  results.push_back(bench_run(&config, "hash_move", BENCH_OPS, [&]() {
+    uint64_t sum = 0;
+    for (int i = 0; i < BENCH_OPS; i++) {
+      int b = i % num_boards;
+      sum += hash_move(hashes[b], moves[b], flips[b], 0);
+    }
+    bench_sink = bench_sink + sum;
+  }));
+  results.push_back(
+      bench_run(&config, "hash_table_insert", BENCH_OPS, [&]() {
+        hash_entry_t entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.flags = HASH_TABLE_FLAGS_USED | BOUND_TYPE_EXACT;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          entry.hash = hashes[i % num_boards];
+          entry.depth = i & 15;
+          entry.value = i;
+          hash_table_insert(hash_table, &entry);
+        }
+      }));
+  // every board is in the table now, so these are all hits
+  results.push_back(
+      bench_run(&config, "hash_table_lookup", BENCH_OPS, [&]() {
+        uint64_t sum = 0;
+        hash_entry_t entry;
+        for (int i = 0; i < BENCH_OPS; i++)
+          sum += hash_table_lookup(hash_table, hashes[i % num_boards], &entry);
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(
+      bench_run(&config, "evaluate_board", BENCH_OPS, [&]() {
+        int64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          int b = i % num_boards;
+          sum += evaluate_board(&boards[b], moves0[b], moves1[b]);
+        }
+        bench_sink = bench_sink + sum;
+      }));
+  // a leaf of a search with the built in evaluation, from the board alone:
+  // with separate move and frontier generation, then with board_gen_features
+  results.push_back(
+      bench_run(&config, "evaluate_leaf_separate", BENCH_OPS, [&]() {
+        int64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          board_t *board = &boards[i % num_boards];
+          auto player0_moves = board_gen_moves(board, 0);
+          auto player1_moves = board_gen_moves(board, 1);
+          auto is_terminal =
+              evaluate_is_terminal(board, player0_moves, player1_moves);
+          sum += is_terminal != 0
+                     ? is_terminal
+                     : evaluate_board(board, player0_moves, player1_moves);
+        }
+        bench_sink = bench_sink + sum;
+      }));
+  results.push_back(bench_run(&config, "evaluate_leaf", BENCH_OPS, [&]() {
+    int64_t sum = 0;
+    for (int i = 0; i < BENCH_OPS; i++)
+      sum += evaluate_leaf(&boards[i % num_boards]);
+    bench_sink = bench_sink + sum;
+  }));
+  // arbitrary weights, only the cost of the lookups matters
+  std::vector<int16_t> pattern_weights(PATTERN_PHASES * PATTERN_WEIGHTS);
+  for (size_t i = 0; i < pattern_weights.size(); i++)
+    pattern_weights[i] = (int16_t)((i * 2654435761u) >> 24) - 128;
+  pattern_evaluate_t pattern_evaluate = pattern_kernel(cpu_selected());
+  results.push_back(
+      bench_run(&config, "pattern_evaluate", BENCH_OPS, [&]() {
+        int64_t sum = 0;
+        for (int i = 0; i < BENCH_OPS; i++) {
+          int b = i % num_boards;
+          sum += pattern_evaluate(pattern_weights.data(), &boards[b],
+                                  moves0[b], moves1[b]);
+        }
+        bench_sink = bench_sink + sum;
+      }));
+  // arbitrary network, likewise
+  nnue_t *net = new nnue_t;
+  int8_t *net_bytes = reinterpret_cast<int8_t *>(net);
+  for (size_t i = 0; i < offsetof(nnue_t, flip_weights); i++)
+    net_bytes[i] = (int8_t)((i * 2654435761u) >> 24);
+  nnue_prepare(net);
+  // the whole network, as evaluate_board runs it
+  results.push_back(bench_run(&config, "nnue_evaluate", BENCH_OPS, [&]() {
+    int64_t sum = 0;
+    nnue_accumulator_t acc;
+    for (int i = 0; i < BENCH_OPS; i++) {
+      nnue_refresh(net, &boards[i % num_boards], &acc);
+      sum += nnue_evaluate(net, &acc);
+    }
+    bench_sink = bench_sink + sum;
+  }));
+  // a move made and undone on the accumulator, and a leaf of a search (the
+  // move made, the accumulator evaluated, and the move undone)
+  results.push_back(bench_run(&config, "nnue_update", BENCH_OPS, [&]() {
+    nnue_accumulator_t acc;
+    nnue_refresh(net, &boards[0], &acc);
+    for (int i = 0; i < BENCH_OPS; i++) {
+      int b = i % num_boards;
+      nnue_do_move(net, &acc, moves[b], flips[b], 0);
+      nnue_undo_move(net, &acc, moves[b], flips[b], 0);
+    }
+    bench_sink = bench_sink + acc.values[0];
+  }));
+  results.push_back(bench_run(&config, "nnue_leaf", BENCH_OPS, [&]() {
+    int64_t sum = 0;
+    nnue_accumulator_t acc;
+    nnue_refresh(net, &boards[0], &acc);
+    for (int i = 0; i < BENCH_OPS; i++) {
+      int b = i % num_boards;
+      nnue_do_move(net, &acc, moves[b], flips[b], 0);
+      sum += nnue_evaluate(net, &acc);
+      nnue_undo_move(net, &acc, moves[b], flips[b], 0);
+    }
+    bench_sink = bench_sink + sum;
+  }));
+  delete net;
+
+  // searches of each pinned position, from an empty table
+  search_config_t search_config = {
+      1,     true,  false, ENDGAME_DEFAULT_EMPTIES, false, {0, 0, 0},
+      false, false, false};
+  for (int p = 0; p < BENCH_POSITIONS; p++) {
+    board_t *board = &boards[p];
+    std::string name = "search_depth_" + std::to_string(config.depth) + "/" +
+                       std::to_string(64 - bits_popcount(board->players[0] |
+                                                         board->players[1]));
+    search_stats_t stats;
+    results.push_back(bench_run(
+        &config, name, 1, [&]() { hash_table_clear(&hash_table); },
+        [&]() {
+          bench_sink = bench_sink + search_depth(board, 0, hash_table,
+                                                 config.depth, &search_config,
+                                                 &stats);
+        }));
+    results.back().nodes = stats.boards_visited;
+  }
+
+  if (config.json != nullptr)
+    bench_write_json(&config, results);
+  return 0;
+}
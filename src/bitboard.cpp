@@ -3,6 +3,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
 
 /** Bitboard Representation
  *    a  b  c  d  e  f  g  h
@@ -55,6 +58,116 @@ static inline bitboard_t bitboard_shift_se(bitboard_t board) {
   return bitboard_shift_e(bitboard_shift_s(board));
 }
 
+/* --- symmetries --- */
+
+/* flip the board upside down (rank 1 <-> rank 8) */
+static constexpr bitboard_t bitboard_flip_vertical(bitboard_t board) {
+  return __builtin_bswap64(board);
+}
+
+/* mirror the board left to right (a file <-> h file) */
+static constexpr bitboard_t bitboard_mirror_horizontal(bitboard_t board) {
+  board = ((board >> 1) & 0x5555555555555555) |
+          ((board & 0x5555555555555555) << 1);
+  board = ((board >> 2) & 0x3333333333333333) |
+          ((board & 0x3333333333333333) << 2);
+  return ((board >> 4) & 0x0f0f0f0f0f0f0f0f) |
+         ((board & 0x0f0f0f0f0f0f0f0f) << 4);
+}
+
+/* flip the board along the a1-h8 diagonal (x <-> y) */
+static constexpr bitboard_t bitboard_flip_diagonal(bitboard_t board) {
+  // swap 4x4 blocks, then 2x2 blocks within them, then single squares
+  bitboard_t t = 0x0f0f0f0f00000000 & (board ^ (board << 28));
+  board ^= t ^ (t >> 28);
+  t = 0x3333000033330000 & (board ^ (board << 14));
+  board ^= t ^ (t >> 14);
+  t = 0x5500550055005500 & (board ^ (board << 7));
+  return board ^ t ^ (t >> 7);
+}
+
+static constexpr bitboard_t bitboard_apply_symmetry(bitboard_t board,
+                                                    int symmetry) {
+  if (symmetry & BOARD_SYMMETRY_DIAGONAL)
+    board = bitboard_flip_diagonal(board);
+  if (symmetry & BOARD_SYMMETRY_HORIZONTAL)
+    board = bitboard_mirror_horizontal(board);
+  if (symmetry & BOARD_SYMMETRY_VERTICAL)
+    board = bitboard_flip_vertical(board);
+  return board;
+}
+
+bitboard_t bitboard_transform(bitboard_t board, int symmetry) {
+  return bitboard_apply_symmetry(board, symmetry);
+}
+
+int board_symmetry_inverse(int symmetry) {
+  // flipping along the diagonal turns a vertical flip into a horizontal one
+  // and the other way around, so undoing the flips after it swaps them
+  if (!(symmetry & BOARD_SYMMETRY_DIAGONAL))
+    return symmetry;
+  int inverse = BOARD_SYMMETRY_DIAGONAL;
+  if (symmetry & BOARD_SYMMETRY_VERTICAL)
+    inverse |= BOARD_SYMMETRY_HORIZONTAL;
+  if (symmetry & BOARD_SYMMETRY_HORIZONTAL)
+    inverse |= BOARD_SYMMETRY_VERTICAL;
+  return inverse;
+}
+
+typedef struct {
+  move_t squares[BOARD_SYMMETRIES][64];
+} symmetry_squares_t;
+
+static constexpr symmetry_squares_t symmetry_squares_gen() {
+  symmetry_squares_t table{};
+  for (int symmetry = 0; symmetry < BOARD_SYMMETRIES; symmetry++) {
+    for (int sq = 0; sq < 64; sq++) {
+      bitboard_t square = bitboard_apply_symmetry(1ULL << sq, symmetry);
+      table.squares[symmetry][sq] = bits_index_of_first_set(square);
+    }
+  }
+  return table;
+}
+
+static constexpr symmetry_squares_t symmetry_squares = symmetry_squares_gen();
+
+move_t move_transform(move_t move, int symmetry) {
+  return symmetry_squares.squares[symmetry][move];
+}
+
+void board_orientations(board_t *board, board_t *dst) {
+  // the flips are shared between the transforms
+  for (int p = 0; p < 2; p++) {
+    bitboard_t b = board->players[p];
+    bitboard_t d = bitboard_flip_diagonal(b);
+    bitboard_t h = bitboard_mirror_horizontal(b);
+    bitboard_t dh = bitboard_mirror_horizontal(d);
+    dst[0].players[p] = b;
+    dst[1].players[p] = bitboard_flip_vertical(b);
+    dst[2].players[p] = h;
+    dst[3].players[p] = bitboard_flip_vertical(h);
+    dst[4].players[p] = d;
+    dst[5].players[p] = bitboard_flip_vertical(d);
+    dst[6].players[p] = dh;
+    dst[7].players[p] = bitboard_flip_vertical(dh);
+  }
+}
+
+int board_canonical(board_t *board, board_t *dst) {
+  board_t boards[BOARD_SYMMETRIES];
+  board_orientations(board, boards);
+
+  int best = 0;
+  for (int symmetry = 1; symmetry < BOARD_SYMMETRIES; symmetry++) {
+    const board_t *a = &boards[symmetry], *b = &boards[best];
+    if (a->players[0] < b->players[0] ||
+        (a->players[0] == b->players[0] && a->players[1] < b->players[1]))
+      best = symmetry;
+  }
+  *dst = boards[best];
+  return best;
+}
+
 /* --- move generation --- */
 
 // consider a row (where U is us, T them)
@@ -69,13 +182,8 @@ static inline bitboard_t bitboard_shift_se(bitboard_t board) {
   }                                                                            \
   moves |= shift_func(tmp) & empty
 
-bitboard_t board_gen_moves(board_t *board, color_t color) {
-  auto us = board->players[color];
-  auto them = board->players[!color];
+CPU_KERNEL bitboard_t scalar_gen_moves(bitboard_t us, bitboard_t them) {
   auto empty = ~(us | them);
-  // make sure us and them don't share any pieces
-  assert(!(us & them));
-
   bitboard_t moves = 0;
   bitboard_t tmp = 0;
 
@@ -87,51 +195,433 @@ bitboard_t board_gen_moves(board_t *board, color_t color) {
   board_gen_moves_case(bitboard_shift_ne);
   board_gen_moves_case(bitboard_shift_sw);
   board_gen_moves_case(bitboard_shift_se);
-
-  assert(!(moves & ~empty));
   return moves;
 }
 
-// making a move follows the same principle as generating, except that we test
-// that the shift after captures is the move
-#define board_make_move_case(shift_func)                                       \
-  captures = shift_func(move) & them;                                          \
+/* --- fused features ---
+ * board_gen_features runs the move generation for both players side by side,
+ * and shifts the empty squares in each direction along with them: the squares
+ * the shifts of the empty squares land on are the squares next to an empty
+ * square, so a player's frontier pieces are their pieces on one of them. The
+ * kernels find the bitboards, board_count_features counts the rest. */
+
+CPU_KERNEL void board_count_features(bitboard_t player0, bitboard_t player1,
+                                     bitboard_t moves0, bitboard_t moves1,
+                                     bitboard_t near_empty,
+                                     board_features_t *features) {
+  const bitboard_t players[2] = {player0, player1};
+  features->moves[0] = moves0;
+  features->moves[1] = moves1;
+  for (int color = 0; color < 2; color++) {
+    features->frontiers[color] = players[color] & near_empty;
+    features->mobility[color] = bits_popcount(features->moves[color]);
+    features->frontier_count[color] = bits_popcount(features->frontiers[color]);
+    features->corners[color] = bits_popcount(players[color] & BOARD_CORNERS);
+    features->x_squares[color] =
+        bits_popcount(players[color] & BOARD_X_SQUARES);
+    features->c_squares[color] =
+        bits_popcount(players[color] & BOARD_C_SQUARES);
+  }
+  features->empties = 64 - bits_popcount(player0 | player1);
+}
+
+#define board_gen_features_case(shift_func)                                    \
+  tmp0 = shift_func(player0) & player1;                                        \
+  tmp1 = shift_func(player1) & player0;                                        \
   for (int i = 0; i < 5; i++) {                                                \
-    captures |= shift_func(captures) & them;                                   \
+    tmp0 |= shift_func(tmp0) & player1;                                        \
+    tmp1 |= shift_func(tmp1) & player0;                                        \
   }                                                                            \
-  if (shift_func(captures) & us) {                                             \
-    *us_ptr |= captures;                                                       \
-    *them_ptr &= ~captures;                                                    \
+  moves0 |= shift_func(tmp0) & empty;                                          \
+  moves1 |= shift_func(tmp1) & empty;                                          \
+  near_empty |= shift_func(empty)
+
+CPU_KERNEL void scalar_gen_features(bitboard_t player0, bitboard_t player1,
+                                    board_features_t *features) {
+  auto empty = ~(player0 | player1);
+  bitboard_t moves0 = 0, moves1 = 0, near_empty = 0;
+  bitboard_t tmp0, tmp1;
+
+  board_gen_features_case(bitboard_shift_n);
+  board_gen_features_case(bitboard_shift_s);
+  board_gen_features_case(bitboard_shift_w);
+  board_gen_features_case(bitboard_shift_e);
+  board_gen_features_case(bitboard_shift_nw);
+  board_gen_features_case(bitboard_shift_ne);
+  board_gen_features_case(bitboard_shift_sw);
+  board_gen_features_case(bitboard_shift_se);
+  board_count_features(player0, player1, moves0, moves1, near_empty, features);
+}
+
+/* --- table driven flips ---
+ * For each square, the ray towards the edge in each direction is precomputed.
+ * Along a ray, the pieces flipped are the opponent's pieces up to the first
+ * square that isn't the opponent's, if that square is ours. The first four
+ * directions go towards higher indices, so that square is the lowest set bit
+ * of the ray's non opponent squares, the other four go towards lower indices,
+ * where it is the highest set bit. */
+
+typedef struct {
+  bitboard_t rays[64][8];
+} flip_rays_t;
+
+static constexpr flip_rays_t flip_rays_gen() {
+  // x and y steps of each direction (e, n, ne, nw, then the opposites)
+  constexpr int dx[8] = {1, 0, 1, -1, -1, 0, -1, 1};
+  constexpr int dy[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+  flip_rays_t table{};
+  for (int sq = 0; sq < 64; sq++) {
+    for (int d = 0; d < 8; d++) {
+      bitboard_t ray = 0;
+      int x = sq % 8 + dx[d], y = sq / 8 + dy[d];
+      for (; x >= 0 && x < 8 && y >= 0 && y < 8; x += dx[d], y += dy[d])
+        ray |= 1ULL << (y * 8 + x);
+      table.rays[sq][d] = ray;
+    }
   }
+  return table;
+}
 
-void board_make_move(board_t *board, move_t move_index, color_t color) {
-  // decode move
-  bitboard_t move = 1ULL << move_index;
+static constexpr flip_rays_t flip_rays = flip_rays_gen();
+
+CPU_KERNEL bitboard_t scalar_gen_flips(bitboard_t us, bitboard_t them,
+                                       move_t move_index) {
+  const bitboard_t *rays = flip_rays.rays[move_index];
+  bitboard_t flips = 0;
+  for (int d = 0; d < 4; d++) {
+    bitboard_t end = rays[d] & ~them;
+    end &= -end;
+    // all ones if the end is ours, zero otherwise
+    bitboard_t keep = -(bitboard_t)((end & us) != 0);
+    flips |= rays[d] & (end - 1) & keep;
+  }
+  for (int d = 4; d < 8; d++) {
+    // the or keeps clz defined, and bit 0 is never an end unless it's on the ray
+    bitboard_t end = 1ULL << bits_index_of_last_set((rays[d] & ~them) | 1);
+    bitboard_t keep = -(bitboard_t)((end & us & rays[d]) != 0);
+    flips |= rays[d] & -(end << 1) & keep;
+  }
+  return flips;
+}
+
+#ifdef CPU_X86
+/* --- avx2 move generation ---
+ * The eight directions are handled four at a time: one 256 bit vector holds
+ * the same bitboard in each 64 bit lane, and each lane is shifted by its own
+ * amount (1, 8, 7 and 9 squares). Shifting left covers w, n, ne and nw,
+ * shifting right covers e, s, sw and se. Instead of masking every shift
+ * result, the edge masks are applied to the boards the shifts are and'ed with,
+ * which gives the same bits. */
+
+// shift amount of each lane
+#define avx2_shifts() _mm256_set_epi64x(9, 7, 8, 1)
+// squares a piece can be shifted onto in each lane, when shifting left / right
+#define avx2_left_mask()                                                       \
+  _mm256_set_epi64x((int64_t)shift_w_mask, (int64_t)shift_e_mask, -1,          \
+                    (int64_t)shift_w_mask)
+#define avx2_right_mask()                                                      \
+  _mm256_set_epi64x((int64_t)shift_e_mask, (int64_t)shift_w_mask, -1,          \
+                    (int64_t)shift_e_mask)
+
+/* or the four lanes together */
+CPU_KERNEL CPU_TARGET_AVX2 bitboard_t avx2_or_lanes(__m256i v) {
+  __m128i x = _mm_or_si128(_mm256_castsi256_si128(v),
+                           _mm256_extracti128_si256(v, 1));
+  x = _mm_or_si128(x, _mm_unpackhi_epi64(x, x));
+  return (bitboard_t)_mm_cvtsi128_si64(x);
+}
+
+#define avx2_gen_moves_case(shift_func, mask)                                  \
+  masked_them = _mm256_and_si256(them, mask);                                  \
+  tmp = _mm256_and_si256(shift_func(us, shifts), masked_them);                 \
+  for (int i = 0; i < 5; i++) {                                                \
+    tmp = _mm256_or_si256(                                                     \
+        tmp, _mm256_and_si256(shift_func(tmp, shifts), masked_them));          \
+  }                                                                            \
+  moves = _mm256_or_si256(                                                     \
+      moves, _mm256_and_si256(shift_func(tmp, shifts),                         \
+                              _mm256_and_si256(empty, mask)))
+
+CPU_KERNEL CPU_TARGET_AVX2 bitboard_t avx2_gen_moves(bitboard_t us_board,
+                                                    bitboard_t them_board) {
+  __m256i us = _mm256_set1_epi64x(us_board);
+  __m256i them = _mm256_set1_epi64x(them_board);
+  __m256i empty = _mm256_set1_epi64x(~(us_board | them_board));
+  __m256i shifts = avx2_shifts();
+  __m256i moves = _mm256_setzero_si256();
+  __m256i masked_them, tmp;
+
+  avx2_gen_moves_case(_mm256_sllv_epi64, avx2_left_mask());
+  avx2_gen_moves_case(_mm256_srlv_epi64, avx2_right_mask());
+
+  return avx2_or_lanes(moves);
+}
+
+// lanes whose captures end in one of our pieces are kept
+#define avx2_gen_flips_case(shift_func, mask)                                  \
+  masked_them = _mm256_and_si256(them, mask);                                  \
+  captures = _mm256_and_si256(shift_func(move, shifts), masked_them);          \
+  for (int i = 0; i < 5; i++) {                                                \
+    captures = _mm256_or_si256(                                                \
+        captures,                                                              \
+        _mm256_and_si256(shift_func(captures, shifts), masked_them));          \
+  }                                                                            \
+  ends = _mm256_and_si256(shift_func(captures, shifts),                        \
+                          _mm256_and_si256(us, mask));                         \
+  flips = _mm256_or_si256(                                                     \
+      flips, _mm256_andnot_si256(_mm256_cmpeq_epi64(ends, zero), captures))
+
+CPU_KERNEL CPU_TARGET_AVX2 bitboard_t avx2_gen_flips(bitboard_t us_board,
+                                                    bitboard_t them_board,
+                                                    move_t move_index) {
+  __m256i move = _mm256_set1_epi64x(1ULL << move_index);
+  __m256i us = _mm256_set1_epi64x(us_board);
+  __m256i them = _mm256_set1_epi64x(them_board);
+  __m256i shifts = avx2_shifts();
+  __m256i zero = _mm256_setzero_si256();
+  __m256i flips = zero;
+  __m256i masked_them, captures, ends;
+
+  avx2_gen_flips_case(_mm256_sllv_epi64, avx2_left_mask());
+  avx2_gen_flips_case(_mm256_srlv_epi64, avx2_right_mask());
+
+  return avx2_or_lanes(flips);
+}
+
+// the moves of both players, and the squares next to an empty square
+#define avx2_gen_features_case(shift_func, mask)                               \
+  masked0 = _mm256_and_si256(player0, mask);                                   \
+  masked1 = _mm256_and_si256(player1, mask);                                   \
+  masked_empty = _mm256_and_si256(empty, mask);                                \
+  tmp0 = _mm256_and_si256(shift_func(player0, shifts), masked1);               \
+  tmp1 = _mm256_and_si256(shift_func(player1, shifts), masked0);               \
+  for (int i = 0; i < 5; i++) {                                                \
+    tmp0 = _mm256_or_si256(                                                    \
+        tmp0, _mm256_and_si256(shift_func(tmp0, shifts), masked1));            \
+    tmp1 = _mm256_or_si256(                                                    \
+        tmp1, _mm256_and_si256(shift_func(tmp1, shifts), masked0));            \
+  }                                                                            \
+  moves0 = _mm256_or_si256(                                                    \
+      moves0, _mm256_and_si256(shift_func(tmp0, shifts), masked_empty));       \
+  moves1 = _mm256_or_si256(                                                    \
+      moves1, _mm256_and_si256(shift_func(tmp1, shifts), masked_empty));       \
+  near_empty = _mm256_or_si256(                                                \
+      near_empty, _mm256_and_si256(shift_func(empty, shifts), mask))
+
+CPU_KERNEL CPU_TARGET_AVX2 void avx2_gen_features(bitboard_t player0_board,
+                                                 bitboard_t player1_board,
+                                                 board_features_t *features) {
+  __m256i player0 = _mm256_set1_epi64x(player0_board);
+  __m256i player1 = _mm256_set1_epi64x(player1_board);
+  __m256i empty = _mm256_set1_epi64x(~(player0_board | player1_board));
+  __m256i shifts = avx2_shifts();
+  __m256i moves0 = _mm256_setzero_si256();
+  __m256i moves1 = _mm256_setzero_si256();
+  __m256i near_empty = _mm256_setzero_si256();
+  __m256i masked0, masked1, masked_empty, tmp0, tmp1;
+
+  avx2_gen_features_case(_mm256_sllv_epi64, avx2_left_mask());
+  avx2_gen_features_case(_mm256_srlv_epi64, avx2_right_mask());
+
+  board_count_features(player0_board, player1_board, avx2_or_lanes(moves0),
+                       avx2_or_lanes(moves1), avx2_or_lanes(near_empty),
+                       features);
+}
+/* --- avx-512 move generation ---
+ * As with avx2, but all eight directions fit in one 512 bit vector. Shifts
+ * are done as rotates, so one instruction covers both shift directions: the
+ * lower four lanes rotate left by 1, 8, 7 and 9 squares, the upper four right
+ * by the same amounts. The bits a rotate wraps around land on the edge row or
+ * file a shift in that direction would have cleared, so the masks also leave
+ * those out. */
+
+#if defined(__GNUC__) && !defined(__clang__)
+// gcc's avx-512 headers trip these warnings on their own placeholder values
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+// rotate amount of each lane (rotating left by 64 - n is rotating right by n)
+#define avx512_rotates() _mm512_set_epi64(55, 57, 56, 63, 9, 7, 8, 1)
+#define avx512_masks()                                                         \
+  _mm512_set_epi64(0x007f7f7f7f7f7f7fLL, 0x00fefefefefefefeLL,                 \
+                   0x00ffffffffffffffLL, 0x7f7f7f7f7f7f7f7fLL,                 \
+                   (int64_t)0xfefefefefefefe00ULL,                             \
+                   0x7f7f7f7f7f7f7f00LL, (int64_t)0xffffffffffffff00ULL,       \
+                   (int64_t)0xfefefefefefefefeULL)
+
+CPU_KERNEL CPU_TARGET_AVX512 bitboard_t avx512_gen_moves(bitboard_t us_board,
+                                                        bitboard_t them_board) {
+  __m512i rotates = avx512_rotates();
+  __m512i mask = avx512_masks();
+  __m512i us = _mm512_set1_epi64(us_board);
+  __m512i them = _mm512_and_si512(_mm512_set1_epi64(them_board), mask);
+  __m512i empty =
+      _mm512_and_si512(_mm512_set1_epi64(~(us_board | them_board)), mask);
+
+  __m512i tmp = _mm512_and_si512(_mm512_rolv_epi64(us, rotates), them);
+  for (int i = 0; i < 5; i++) {
+    tmp = _mm512_or_si512(
+        tmp, _mm512_and_si512(_mm512_rolv_epi64(tmp, rotates), them));
+  }
+  __m512i moves = _mm512_and_si512(_mm512_rolv_epi64(tmp, rotates), empty);
+  return (bitboard_t)_mm512_reduce_or_epi64(moves);
+}
+
+CPU_KERNEL CPU_TARGET_AVX512 bitboard_t avx512_gen_flips(bitboard_t us_board,
+                                                        bitboard_t them_board,
+                                                        move_t move_index) {
+  __m512i rotates = avx512_rotates();
+  __m512i mask = avx512_masks();
+  __m512i move = _mm512_set1_epi64(1ULL << move_index);
+  __m512i us = _mm512_and_si512(_mm512_set1_epi64(us_board), mask);
+  __m512i them = _mm512_and_si512(_mm512_set1_epi64(them_board), mask);
+
+  __m512i captures = _mm512_and_si512(_mm512_rolv_epi64(move, rotates), them);
+  for (int i = 0; i < 5; i++) {
+    captures = _mm512_or_si512(
+        captures, _mm512_and_si512(_mm512_rolv_epi64(captures, rotates), them));
+  }
+  // lanes whose captures end in one of our pieces are kept
+  __m512i ends = _mm512_and_si512(_mm512_rolv_epi64(captures, rotates), us);
+  __m512i flips =
+      _mm512_maskz_mov_epi64(_mm512_test_epi64_mask(ends, ends), captures);
+  return (bitboard_t)_mm512_reduce_or_epi64(flips);
+}
+
+CPU_KERNEL CPU_TARGET_AVX512 void
+avx512_gen_features(bitboard_t player0_board, bitboard_t player1_board,
+                    board_features_t *features) {
+  __m512i rotates = avx512_rotates();
+  __m512i mask = avx512_masks();
+  __m512i empty = _mm512_set1_epi64(~(player0_board | player1_board));
+  __m512i player0 = _mm512_set1_epi64(player0_board);
+  __m512i player1 = _mm512_set1_epi64(player1_board);
+  __m512i masked0 = _mm512_and_si512(player0, mask);
+  __m512i masked1 = _mm512_and_si512(player1, mask);
+  __m512i masked_empty = _mm512_and_si512(empty, mask);
+
+  __m512i tmp0 = _mm512_and_si512(_mm512_rolv_epi64(player0, rotates), masked1);
+  __m512i tmp1 = _mm512_and_si512(_mm512_rolv_epi64(player1, rotates), masked0);
+  for (int i = 0; i < 5; i++) {
+    tmp0 = _mm512_or_si512(
+        tmp0, _mm512_and_si512(_mm512_rolv_epi64(tmp0, rotates), masked1));
+    tmp1 = _mm512_or_si512(
+        tmp1, _mm512_and_si512(_mm512_rolv_epi64(tmp1, rotates), masked0));
+  }
+  __m512i moves0 =
+      _mm512_and_si512(_mm512_rolv_epi64(tmp0, rotates), masked_empty);
+  __m512i moves1 =
+      _mm512_and_si512(_mm512_rolv_epi64(tmp1, rotates), masked_empty);
+  __m512i near_empty =
+      _mm512_and_si512(_mm512_rolv_epi64(empty, rotates), mask);
+
+  board_count_features(player0_board, player1_board,
+                       (bitboard_t)_mm512_reduce_or_epi64(moves0),
+                       (bitboard_t)_mm512_reduce_or_epi64(moves1),
+                       (bitboard_t)_mm512_reduce_or_epi64(near_empty),
+                       features);
+}
+#endif
+
+/* --- kernel dispatch --- */
+
+typedef struct {
+  bitboard_t (*gen_moves)(bitboard_t us, bitboard_t them);
+  bitboard_t (*gen_flips)(bitboard_t us, bitboard_t them, move_t move_index);
+  void (*gen_features)(bitboard_t player0, bitboard_t player1,
+                       board_features_t *features);
+} board_kernels_t;
+
+// the kernels of one variant, compiled with its target attribute
+#define board_kernels_variant(name, target, moves_kernel, flips_kernel,        \
+                              features_kernel)                                 \
+  target static bitboard_t name##_moves(bitboard_t us, bitboard_t them) {      \
+    return moves_kernel(us, them);                                             \
+  }                                                                            \
+  target static bitboard_t name##_flips(bitboard_t us, bitboard_t them,        \
+                                        move_t move_index) {                   \
+    return flips_kernel(us, them, move_index);                                 \
+  }                                                                            \
+  target static void name##_features(bitboard_t player0, bitboard_t player1,   \
+                                     board_features_t *features) {             \
+    features_kernel(player0, player1, features);                               \
+  }
+
+board_kernels_variant(baseline, , scalar_gen_moves, scalar_gen_flips,
+                      scalar_gen_features)
+#ifdef CPU_X86
+board_kernels_variant(popcnt_bmi2, CPU_TARGET_POPCNT_BMI2, scalar_gen_moves,
+                      scalar_gen_flips, scalar_gen_features)
+board_kernels_variant(avx2, CPU_TARGET_AVX2, avx2_gen_moves, avx2_gen_flips,
+                      avx2_gen_features)
+board_kernels_variant(avx512, CPU_TARGET_AVX512, avx512_gen_moves,
+                      avx512_gen_flips, avx512_gen_features)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+static const board_kernels_t board_kernels_variants[CPU_VARIANTS] = {
+    {baseline_moves, baseline_flips, baseline_features},
+#ifdef CPU_X86
+    {popcnt_bmi2_moves, popcnt_bmi2_flips, popcnt_bmi2_features},
+    {avx2_moves, avx2_flips, avx2_features},
+    {avx512_moves, avx512_flips, avx512_features},
+#else
+    {baseline_moves, baseline_flips, baseline_features},
+    {baseline_moves, baseline_flips, baseline_features},
+    {baseline_moves, baseline_flips, baseline_features},
+#endif
+};
+
+static board_kernels_t board_kernels = board_kernels_variants[cpu_detect()];
+
+void board_select_kernels(cpu_variant_t variant) {
+  board_kernels = board_kernels_variants[variant];
+}
+
+bitboard_t board_gen_moves(board_t *board, color_t color) {
+  auto us = board->players[color];
+  auto them = board->players[!color];
+  // make sure us and them don't share any pieces
+  assert(!(us & them));
 
-  auto us_ptr = &board->players[color];
-  auto them_ptr = &board->players[!color];
-  auto us = *us_ptr;
-  auto them = *them_ptr;
+  bitboard_t moves = board_kernels.gen_moves(us, them);
+
+  assert(!(moves & (us | them)));
+  return moves;
+}
 
-  bitboard_t captures = 0;
+bitboard_t board_gen_flips(board_t *board, move_t move_index, color_t color) {
+  auto us = board->players[color];
+  auto them = board->players[!color];
 
   assert(!(us & them));
-  assert((~(us | them)) & move);
+  assert(!((us | them) & (1ULL << move_index)));
+
+  return board_kernels.gen_flips(us, them, move_index);
+}
+
+void board_gen_features(board_t *board, board_features_t *features) {
+  assert(!(board->players[0] & board->players[1]));
+
+  board_kernels.gen_features(board->players[0], board->players[1], features);
+
+  assert(!((features->moves[0] | features->moves[1]) &
+           (board->players[0] | board->players[1])));
+}
+
+void board_make_move(board_t *board, move_t move_index, color_t color) {
 #ifndef NDEBUG
-  auto total_pieces = bits_popcount(us | them);
+  auto total_pieces = bits_popcount(board->players[0] | board->players[1]);
 #endif
+  auto flips = board_gen_flips(board, move_index, color);
+  board_do_move(board, move_index, flips, color);
 
-  *us_ptr |= move;
-  board_make_move_case(bitboard_shift_n);
-  board_make_move_case(bitboard_shift_s);
-  board_make_move_case(bitboard_shift_w);
-  board_make_move_case(bitboard_shift_e);
-  board_make_move_case(bitboard_shift_nw);
-  board_make_move_case(bitboard_shift_ne);
-  board_make_move_case(bitboard_shift_sw);
-  board_make_move_case(bitboard_shift_se);
-
-  assert(bits_popcount(*us_ptr | *them_ptr) - total_pieces == 1);
+  assert(bits_popcount(board->players[0] | board->players[1]) - total_pieces ==
+         1);
 }
 
 #define board_frontier_case(func, inverse_func) \
@@ -159,6 +649,59 @@ bitboard_t board_gen_frontiers(board_t *board, color_t color) {
   return frontier;
 }
 
+/* --- stability --- */
+
+// squares with no neighbor on one side along each line direction
+#define stable_edge_h 0x8181818181818181
+#define stable_edge_v 0xff000000000000ff
+#define stable_edge_d 0xff818181818181ff
+
+// squares whose line (in the shift_a / shift_b direction) has no empty square
+#define board_full_line(dst, shift_a, shift_b)                                 \
+  tmp = empty;                                                                 \
+  for (int i = 0; i < 7; i++) {                                                \
+    tmp |= shift_a(tmp) | shift_b(tmp);                                        \
+  }                                                                            \
+  dst = ~tmp
+
+// squares with a stable piece (or the edge) next to them along the line
+#define board_stable_neighbor(shift_a, shift_b, edge)                          \
+  (shift_a(stable) | shift_b(stable) | (edge))
+
+// a piece can't be flipped along a line that is full, or along a line where
+// it sits next to the edge or to a stable piece of its own color (the run of
+// pieces it belongs to could never be bracketed). A piece that can't be flipped
+// along any of the four lines is stable. Starting with no stable pieces, and
+// adding pieces until nothing changes, gives a lower bound on the stable pieces
+bitboard_t board_gen_stable(board_t *board, color_t color) {
+  auto us = board->players[color];
+  auto empty = ~(board->players[0] | board->players[1]);
+  bitboard_t tmp;
+
+  bitboard_t full_h, full_v, full_d1, full_d2;
+  board_full_line(full_h, bitboard_shift_w, bitboard_shift_e);
+  board_full_line(full_v, bitboard_shift_n, bitboard_shift_s);
+  board_full_line(full_d1, bitboard_shift_ne, bitboard_shift_sw);
+  board_full_line(full_d2, bitboard_shift_nw, bitboard_shift_se);
+
+  bitboard_t stable = 0;
+  while (true) {
+    auto next =
+        us &
+        (full_h | board_stable_neighbor(bitboard_shift_w, bitboard_shift_e,
+                                        stable_edge_h)) &
+        (full_v | board_stable_neighbor(bitboard_shift_n, bitboard_shift_s,
+                                        stable_edge_v)) &
+        (full_d1 | board_stable_neighbor(bitboard_shift_ne, bitboard_shift_sw,
+                                         stable_edge_d)) &
+        (full_d2 | board_stable_neighbor(bitboard_shift_nw, bitboard_shift_se,
+                                         stable_edge_d));
+    if (next == stable)
+      return stable;
+    stable = next;
+  }
+}
+
 move_t bitboard_get_and_clear_first_move(bitboard_t *board) {
 #ifndef NDEBUG
   int pbits = bits_popcount(*board);
@@ -172,6 +715,14 @@ move_t bitboard_get_and_clear_first_move(bitboard_t *board) {
   return move;
 }
 
+move_t bitboard_get_and_clear_last_move(bitboard_t *board) {
+  assert(!!*board);
+  move_t move = bits_index_of_last_set(*board);
+  *board &= ~(1ULL << move);
+
+  return move;
+}
+
 void board_set_cell(board_t *board, move_t location, color_t color) {
   if (color == 255) {
     board->players[0] &= ~(1ULL << location);
@@ -1,11 +1,14 @@
 #pragma once
 
+#include "cpu.hpp"
 #include <cstdint>
 
 /* count the number of set bits in a (x86 popcnt) */
 #define bits_popcount(a) __builtin_popcountll(a)
 /* get the index of the first set bit in a (starting at lsb) (x86 bsf) */
 #define bits_index_of_first_set(a) __builtin_ctzll(a)
+/* get the index of the last set bit in a (starting at lsb) (x86 bsr) */
+#define bits_index_of_last_set(a) (63 - __builtin_clzll(a))
 
 /**
  * An Othello bitboard.
@@ -35,6 +38,11 @@ typedef struct {
  * Set a cell on a board to the given color, or empty if color == 255 */
 void board_set_cell(board_t *board, move_t location, color_t color);
 
+/**
+ * Use the move generation, flip and feature kernels of variant (see
+ * cpu_select) */
+void board_select_kernels(cpu_variant_t variant);
+
 /**
  * Generate all legal moves for the given color
  * Moves are returned as a bitboard, where a set bit indicates a legal move */
@@ -45,16 +53,111 @@ bitboard_t board_gen_moves(board_t *board, color_t color);
  * Returns a bitboard, where set bits indicate a frontier pieces */
 bitboard_t board_gen_frontiers(board_t *board, color_t color);
 
+// the corners, the squares diagonally next to them (x squares) and the squares
+// beside them on the edge (c squares)
+#define BOARD_CORNERS   0x8100000000000081
+#define BOARD_X_SQUARES 0x0042000000004200
+#define BOARD_C_SQUARES 0x4281000000008142
+
+/**
+ * What the built in evaluation looks at, for both players (indexed by color)
+ * moves and frontiers are as board_gen_moves and board_gen_frontiers give
+ * them, the counts are the pieces each player has on those squares */
+typedef struct {
+  bitboard_t moves[2];
+  bitboard_t frontiers[2];
+  int mobility[2];
+  int frontier_count[2];
+  int corners[2];
+  int x_squares[2];
+  int c_squares[2];
+  int empties;
+} board_features_t;
+
+/**
+ * Generate the features of board in one pass
+ * Both players' moves come from the same eight shifts, and the squares next
+ * to an empty square (giving the frontiers) from shifting the empty squares
+ * alongside them, instead of two board_gen_moves and two board_gen_frontiers
+ * calls each shifting the board again */
+void board_gen_features(board_t *board, board_features_t *features);
+
+/**
+ * Find pieces of the given color that can never be flipped again
+ * Returns a lower bound: every set bit is a stable piece, but not every stable
+ * piece is found */
+bitboard_t board_gen_stable(board_t *board, color_t color);
+
+/**
+ * Find the enemy pieces that would be flipped by a move for the given color
+ * Returns a bitboard of the flipped pieces (empty if the move isn't legal) */
+bitboard_t board_gen_flips(board_t *board, move_t move_index, color_t color);
+
 /**
  * Make a move on a full board. Places a piece at the move location, and flips
  * appropriate enemy pieces */
 void board_make_move(board_t *board, move_t move_index, color_t color);
 
+/**
+ * Make a move in place, given the pieces it flips (from board_gen_flips)
+ * The flips are all that changes on the board, so callers can keep them to
+ * update anything derived from the board (hashes, evaluation features), and to
+ * undo the move */
+static inline void board_do_move(board_t *board, move_t move_index,
+                                 bitboard_t flips, color_t color) {
+  board->players[color] ^= flips | (1ULL << move_index);
+  board->players[!color] ^= flips;
+}
+
+/**
+ * Undo board_do_move (with the same move, flips and color) */
+static inline void board_undo_move(board_t *board, move_t move_index,
+                                   bitboard_t flips, color_t color) {
+  board->players[color] ^= flips | (1ULL << move_index);
+  board->players[!color] ^= flips;
+}
+
+/**
+ * Symmetries
+ * The board looks the same to both players after any of 8 symmetries (the
+ * rotations and reflections of the square). A symmetry is a combination of the
+ * flips below, applied in the order listed. */
+#define BOARD_SYMMETRIES 8
+// flip along the a1-h8 diagonal (x <-> y)
+#define BOARD_SYMMETRY_DIAGONAL 4
+// mirror the a and h files
+#define BOARD_SYMMETRY_HORIZONTAL 2
+// flip ranks 1 and 8
+#define BOARD_SYMMETRY_VERTICAL 1
+
+/* transform a bitboard by a symmetry */
+bitboard_t bitboard_transform(bitboard_t board, int symmetry);
+
+/* the symmetry that undoes symmetry */
+int board_symmetry_inverse(int symmetry);
+
+/* the square move ends up on when the board is transformed by symmetry */
+move_t move_transform(move_t move, int symmetry);
+
+/* transform board by every symmetry (dst[symmetry], BOARD_SYMMETRIES boards) */
+void board_orientations(board_t *board, board_t *dst);
+
+/**
+ * Find the orientation of board that comes first (with the smallest
+ * players[0], then players[1]), so that all 8 orientations of a board have
+ * the same canonical board. The canonical board is written to dst, and the
+ * symmetry that transforms board into it is returned */
+int board_canonical(board_t *board, board_t *dst);
+
 /**
  * Given a bitboard produced by full_board_gen_moves, convert the first set bit
  * into a move_t (returned), and clear it from the bitboard */
 move_t bitboard_get_and_clear_first_move(bitboard_t *board);
 
+/**
+ * Same as bitboard_get_and_clear_first_move, but takes the last set bit */
+move_t bitboard_get_and_clear_last_move(bitboard_t *board);
+
 /**
  * Convert a move_t to x and y coordinates on the board */
 void move_to_xy(move_t move, int *x, int *y);
@@ -0,0 +1,274 @@
+#include "bitboard_batch.hpp"
+#include <cstring>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+/* The kernels below are written once in terms of vector operations, which are
+ * defined for each instruction set with a prefix of its own (avx2_batch_and,
+ * avx512_batch_and, ...), and compiled with that variant's target attribute,
+ * whatever the program is built for. The variant in use is picked with the
+ * single board kernels (see cpu_select). Boards left over at the end of a
+ * batch (or all of them, without vector instructions) go through the single
+ * board functions. */
+
+#ifdef CPU_X86
+// squares a piece can be shifted onto without wrapping around a row: shifting
+// by 1 and 9 to the left, or by 7 to the right, can't land on the a file, and
+// the other way around for the h file
+#define BATCH_NOT_A_FILE 0xfefefefefefefefeULL
+#define BATCH_NOT_H_FILE 0x7f7f7f7f7f7f7f7fULL
+#define BATCH_ALL ~0ULL
+
+/* calls case_macro with the operations of isa for each of the eight
+ * directions */
+#define batch_each_direction(case_macro, isa)                                  \
+  case_macro(isa, shl, 1, BATCH_NOT_A_FILE);                                   \
+  case_macro(isa, shl, 8, BATCH_ALL);                                          \
+  case_macro(isa, shl, 7, BATCH_NOT_H_FILE);                                   \
+  case_macro(isa, shl, 9, BATCH_NOT_A_FILE);                                   \
+  case_macro(isa, shr, 1, BATCH_NOT_H_FILE);                                   \
+  case_macro(isa, shr, 8, BATCH_ALL);                                          \
+  case_macro(isa, shr, 7, BATCH_NOT_A_FILE);                                   \
+  case_macro(isa, shr, 9, BATCH_NOT_H_FILE)
+
+// as board_gen_moves_case, with the edge mask applied to them and empty
+// instead of to each shift
+#define batch_moves_case(isa, shift, n, mask)                                  \
+  masked_them = isa##_batch_and(them, isa##_batch_set1(mask));                 \
+  tmp = isa##_batch_and(isa##_batch_##shift(us, n), masked_them);              \
+  for (int k = 0; k < 5; k++) {                                                \
+    tmp = isa##_batch_or(                                                      \
+        tmp, isa##_batch_and(isa##_batch_##shift(tmp, n), masked_them));       \
+  }                                                                            \
+  moves = isa##_batch_or(                                                      \
+      moves,                                                                   \
+      isa##_batch_and(isa##_batch_##shift(tmp, n),                             \
+                      isa##_batch_and(empty, isa##_batch_set1(mask))))
+
+// captures along a direction only flip if they end in one of our pieces
+#define batch_flips_case(isa, shift, n, mask)                                  \
+  masked_them = isa##_batch_and(them, isa##_batch_set1(mask));                 \
+  captures = isa##_batch_and(isa##_batch_##shift(move, n), masked_them);       \
+  for (int k = 0; k < 5; k++) {                                                \
+    captures = isa##_batch_or(                                                 \
+        captures,                                                              \
+        isa##_batch_and(isa##_batch_##shift(captures, n), masked_them));       \
+  }                                                                            \
+  ends = isa##_batch_and(isa##_batch_##shift(captures, n),                     \
+                         isa##_batch_and(us, isa##_batch_set1(mask)));         \
+  flips = isa##_batch_or(flips, isa##_batch_keep_nonzero(ends, captures))
+
+// a frontier piece is a piece some empty square shifts onto
+#define batch_frontier_case(isa, shift, n, mask)                               \
+  near_empty = isa##_batch_or(                                                 \
+      near_empty,                                                              \
+      isa##_batch_and(isa##_batch_##shift(empty, n), isa##_batch_set1(mask)))
+
+// the moves, flips and frontiers kernels of isa, on vectors of type vec_t
+#define batch_vec_kernels(isa, target, vec_t)                                  \
+  CPU_KERNEL target vec_t isa##_batch_moves(vec_t us, vec_t them) {            \
+    vec_t empty = isa##_batch_xor(isa##_batch_or(us, them),                    \
+                                  isa##_batch_set1(BATCH_ALL));                \
+    vec_t moves = isa##_batch_set1(0);                                         \
+    vec_t masked_them, tmp;                                                    \
+    batch_each_direction(batch_moves_case, isa);                               \
+    return moves;                                                              \
+  }                                                                            \
+  CPU_KERNEL target vec_t isa##_batch_flips(vec_t us, vec_t them,              \
+                                            vec_t move) {                      \
+    vec_t flips = isa##_batch_set1(0);                                         \
+    vec_t masked_them, captures, ends;                                         \
+    batch_each_direction(batch_flips_case, isa);                               \
+    return flips;                                                              \
+  }                                                                            \
+  CPU_KERNEL target vec_t isa##_batch_frontiers(vec_t us, vec_t them) {        \
+    vec_t empty = isa##_batch_xor(isa##_batch_or(us, them),                    \
+                                  isa##_batch_set1(BATCH_ALL));                \
+    vec_t near_empty = isa##_batch_set1(0);                                    \
+    batch_each_direction(batch_frontier_case, isa);                            \
+    return isa##_batch_and(us, near_empty);                                    \
+  }
+
+/* --- avx2, 4 boards per vector --- */
+#define avx2_batch_load(p) _mm256_loadu_si256((const __m256i *)(p))
+#define avx2_batch_store(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define avx2_batch_set1(x) _mm256_set1_epi64x((long long)(x))
+#define avx2_batch_and(a, b) _mm256_and_si256(a, b)
+#define avx2_batch_xor(a, b) _mm256_xor_si256(a, b)
+#define avx2_batch_or(a, b) _mm256_or_si256(a, b)
+#define avx2_batch_shl(a, n) _mm256_slli_epi64(a, n)
+#define avx2_batch_shr(a, n) _mm256_srli_epi64(a, n)
+/* lanes of v where test is nonzero, zero in the others */
+#define avx2_batch_keep_nonzero(test, v)                                       \
+  _mm256_andnot_si256(_mm256_cmpeq_epi64(test, _mm256_setzero_si256()), v)
+
+/* 1 << moves[i] for the next 4 moves */
+CPU_KERNEL CPU_TARGET_AVX2 __m256i avx2_batch_move_bits(const move_t *moves) {
+  int32_t bytes;
+  memcpy(&bytes, moves, sizeof(bytes));
+  return _mm256_sllv_epi64(_mm256_set1_epi64x(1),
+                           _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes)));
+}
+
+batch_vec_kernels(avx2, CPU_TARGET_AVX2, __m256i)
+
+/* --- avx-512, 8 boards per vector --- */
+#if defined(__GNUC__) && !defined(__clang__)
+// gcc's avx-512 headers trip these warnings on their own placeholder values
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#define avx512_batch_load(p) _mm512_loadu_si512((const void *)(p))
+#define avx512_batch_store(p, v) _mm512_storeu_si512((void *)(p), v)
+#define avx512_batch_set1(x) _mm512_set1_epi64((long long)(x))
+#define avx512_batch_and(a, b) _mm512_and_si512(a, b)
+#define avx512_batch_xor(a, b) _mm512_xor_si512(a, b)
+#define avx512_batch_or(a, b) _mm512_or_si512(a, b)
+#define avx512_batch_shl(a, n) _mm512_slli_epi64(a, n)
+#define avx512_batch_shr(a, n) _mm512_srli_epi64(a, n)
+#define avx512_batch_keep_nonzero(test, v)                                     \
+  _mm512_maskz_mov_epi64(_mm512_test_epi64_mask(test, test), v)
+
+CPU_KERNEL CPU_TARGET_AVX512 __m512i
+avx512_batch_move_bits(const move_t *moves) {
+  __m128i bytes = _mm_loadl_epi64((const __m128i *)moves);
+  return _mm512_sllv_epi64(_mm512_set1_epi64(1), _mm512_cvtepu8_epi64(bytes));
+}
+
+batch_vec_kernels(avx512, CPU_TARGET_AVX512, __m512i)
+#endif
+
+/* --- kernel dispatch ---
+ * Each variant's functions handle the boards of a batch that fill whole
+ * vectors, and return how many they handled; the public functions do the
+ * rest one board at a time. */
+
+typedef struct {
+  int (*gen_moves)(const board_batch_t *batch, bitboard_t *dst_moves);
+  int (*gen_flips)(const board_batch_t *batch, const move_t *moves,
+                   bitboard_t *dst_flips);
+  int (*counts)(const board_batch_t *batch, int32_t *dst_mobility,
+                int32_t *dst_frontiers);
+} board_batch_kernels_t;
+
+// the variants without vector move generation leave every board to the single
+// board functions
+static int scalar_gen_moves(const board_batch_t *batch, bitboard_t *dst_moves) {
+  return 0;
+}
+static int scalar_gen_flips(const board_batch_t *batch, const move_t *moves,
+                            bitboard_t *dst_flips) {
+  return 0;
+}
+static int scalar_counts(const board_batch_t *batch, int32_t *dst_mobility,
+                         int32_t *dst_frontiers) {
+  return 0;
+}
+
+#ifdef CPU_X86
+// the batch functions of isa, compiled with its target attribute, for vectors
+// of width boards
+#define board_batch_variant(isa, target, vec_t, width)                         \
+  target static int isa##_gen_moves(const board_batch_t *batch,                \
+                                    bitboard_t *dst_moves) {                   \
+    int i = 0;                                                                 \
+    for (; i + width <= batch->count; i += width) {                            \
+      vec_t moves = isa##_batch_moves(isa##_batch_load(&batch->players[i]),    \
+                                      isa##_batch_load(&batch->opponents[i])); \
+      isa##_batch_store(&dst_moves[i], moves);                                 \
+    }                                                                          \
+    return i;                                                                  \
+  }                                                                            \
+  target static int isa##_gen_flips(const board_batch_t *batch,                \
+                                    const move_t *moves,                       \
+                                    bitboard_t *dst_flips) {                   \
+    int i = 0;                                                                 \
+    for (; i + width <= batch->count; i += width) {                            \
+      vec_t flips = isa##_batch_flips(isa##_batch_load(&batch->players[i]),    \
+                                      isa##_batch_load(&batch->opponents[i]),  \
+                                      isa##_batch_move_bits(&moves[i]));       \
+      isa##_batch_store(&dst_flips[i], flips);                                 \
+    }                                                                          \
+    return i;                                                                  \
+  }                                                                            \
+  target static int isa##_counts(const board_batch_t *batch,                   \
+                                 int32_t *dst_mobility,                        \
+                                 int32_t *dst_frontiers) {                     \
+    int i = 0;                                                                 \
+    for (; i + width <= batch->count; i += width) {                            \
+      vec_t us = isa##_batch_load(&batch->players[i]);                         \
+      vec_t them = isa##_batch_load(&batch->opponents[i]);                     \
+      bitboard_t moves[width], frontiers[width];                               \
+      isa##_batch_store(moves, isa##_batch_moves(us, them));                   \
+      isa##_batch_store(frontiers, isa##_batch_frontiers(us, them));           \
+      for (int k = 0; k < width; k++) {                                        \
+        dst_mobility[i + k] = bits_popcount(moves[k]);                         \
+        dst_frontiers[i + k] = bits_popcount(frontiers[k]);                    \
+      }                                                                        \
+    }                                                                          \
+    return i;                                                                  \
+  }
+
+board_batch_variant(avx2, CPU_TARGET_AVX2, __m256i, 4)
+board_batch_variant(avx512, CPU_TARGET_AVX512, __m512i, 8)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+static const board_batch_kernels_t board_batch_variants[CPU_VARIANTS] = {
+    {scalar_gen_moves, scalar_gen_flips, scalar_counts},
+    {scalar_gen_moves, scalar_gen_flips, scalar_counts},
+#ifdef CPU_X86
+    {avx2_gen_moves, avx2_gen_flips, avx2_counts},
+    {avx512_gen_moves, avx512_gen_flips, avx512_counts},
+#else
+    {scalar_gen_moves, scalar_gen_flips, scalar_counts},
+    {scalar_gen_moves, scalar_gen_flips, scalar_counts},
+#endif
+};
+
+static board_batch_kernels_t board_batch_kernels =
+    board_batch_variants[cpu_detect()];
+
+void board_batch_select_kernels(cpu_variant_t variant) {
+  board_batch_kernels = board_batch_variants[variant];
+}
+
+/* the single board a batch entry describes */
+static inline board_t batch_board(const board_batch_t *batch, int i) {
+  board_t board;
+  board.players[0] = batch->players[i];
+  board.players[1] = batch->opponents[i];
+  return board;
+}
+
+void board_batch_gen_moves(const board_batch_t *batch, bitboard_t *dst_moves) {
+  for (int i = board_batch_kernels.gen_moves(batch, dst_moves);
+       i < batch->count; i++) {
+    board_t board = batch_board(batch, i);
+    dst_moves[i] = board_gen_moves(&board, 0);
+  }
+}
+
+void board_batch_gen_flips(const board_batch_t *batch, const move_t *moves,
+                           bitboard_t *dst_flips) {
+  for (int i = board_batch_kernels.gen_flips(batch, moves, dst_flips);
+       i < batch->count; i++) {
+    board_t board = batch_board(batch, i);
+    dst_flips[i] = board_gen_flips(&board, moves[i], 0);
+  }
+}
+
+void board_batch_counts(const board_batch_t *batch, int32_t *dst_mobility,
+                        int32_t *dst_frontiers) {
+  for (int i = board_batch_kernels.counts(batch, dst_mobility, dst_frontiers);
+       i < batch->count; i++) {
+    board_t board = batch_board(batch, i);
+    dst_mobility[i] = bits_popcount(board_gen_moves(&board, 0));
+    dst_frontiers[i] = bits_popcount(board_gen_frontiers(&board, 0));
+  }
+}
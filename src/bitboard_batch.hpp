@@ -0,0 +1,38 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include "cpu.hpp"
+#include <cstdint>
+
+/**
+ * Batched bitboard operations
+ * Work on many unrelated boards at once, stored as a structure of arrays: the
+ * pieces of the player to move on board i are players[i], the opponent's are
+ * opponents[i]. Boards are processed 8 at a time with the avx-512 kernels, 4
+ * at a time with the avx2 ones (each vector lane holds a different board, and
+ * all lanes shift in the same direction), and one at a time otherwise. The
+ * kernels are picked at runtime, with the single board ones. The results are
+ * the same as the single board functions'.
+ */
+typedef struct {
+  const bitboard_t *players;
+  const bitboard_t *opponents;
+  int count;
+} board_batch_t;
+
+/* legal moves of the player to move on each board (as board_gen_moves) */
+void board_batch_gen_moves(const board_batch_t *batch, bitboard_t *dst_moves);
+
+/* pieces flipped by playing moves[i] on board i (as board_gen_flips); every
+ * move must be on an empty square */
+void board_batch_gen_flips(const board_batch_t *batch, const move_t *moves,
+                           bitboard_t *dst_flips);
+
+/* number of legal moves and of frontier pieces (as board_gen_frontiers) of the
+ * player to move on each board */
+void board_batch_counts(const board_batch_t *batch, int32_t *dst_mobility,
+                        int32_t *dst_frontiers);
+
+/**
+ * Use the batch kernels of variant (see cpu_select) */
+void board_batch_select_kernels(cpu_variant_t variant);
@@ -0,0 +1,64 @@
+#include "cpu.hpp"
+#include "bitboard.hpp"
+#include "bitboard_batch.hpp"
+#include "evaluator.hpp"
+#include <cassert>
+#include <cstring>
+
+const char *const cpu_variant_names[CPU_VARIANTS] = {"baseline", "popcnt-bmi2",
+                                                     "avx2", "avx512"};
+
+bool cpu_supports(cpu_variant_t variant) {
+#ifdef CPU_X86
+  // may run before the constructors that would otherwise set this up
+  __builtin_cpu_init();
+  bool popcnt_bmi2 = __builtin_cpu_supports("popcnt") &&
+                     __builtin_cpu_supports("bmi") &&
+                     __builtin_cpu_supports("bmi2");
+  switch (variant) {
+  case CPU_BASELINE:
+    return true;
+  case CPU_POPCNT_BMI2:
+    return popcnt_bmi2;
+  case CPU_AVX2:
+    return popcnt_bmi2 && __builtin_cpu_supports("avx2");
+  case CPU_AVX512:
+    return popcnt_bmi2 && __builtin_cpu_supports("avx2") &&
+           __builtin_cpu_supports("avx512f");
+  default:
+    return false;
+  }
+#else
+  // only the baseline kernels are compiled
+  return variant == CPU_BASELINE;
+#endif
+}
+
+cpu_variant_t cpu_detect() {
+  int variant = CPU_VARIANTS - 1;
+  while (variant > CPU_BASELINE && !cpu_supports((cpu_variant_t)variant))
+    variant--;
+  return (cpu_variant_t)variant;
+}
+
+bool cpu_variant_parse(const char *name, cpu_variant_t *dst) {
+  for (int variant = 0; variant < CPU_VARIANTS; variant++) {
+    if (strcmp(name, cpu_variant_names[variant]) == 0) {
+      *dst = (cpu_variant_t)variant;
+      return true;
+    }
+  }
+  return false;
+}
+
+static cpu_variant_t cpu_variant = cpu_detect();
+
+void cpu_select(cpu_variant_t variant) {
+  assert(cpu_supports(variant));
+  cpu_variant = variant;
+  board_select_kernels(variant);
+  board_batch_select_kernels(variant);
+  evaluator_select_kernels(variant);
+}
+
+cpu_variant_t cpu_selected() { return cpu_variant; }
@@ -0,0 +1,55 @@
+#pragma once
+
+/**
+ * CPU feature dispatch
+ * The hot bitboard and evaluation kernels are compiled once per variant
+ * below, each allowed to use a different set of instructions, and the variant
+ * used is picked once at startup. By default that's the best one the cpu
+ * supports, so the same binary runs on older hosts and makes use of newer
+ * ones. */
+typedef enum {
+  // whatever the program is compiled for (plain x86-64 by default)
+  CPU_BASELINE,
+  // popcnt, lzcnt, and bmi1/2 (tzcnt, blsi, ...)
+  CPU_POPCNT_BMI2,
+  // the above, and avx2 move generation
+  CPU_AVX2,
+  // the above, and avx-512 move generation
+  CPU_AVX512,
+  CPU_VARIANTS
+} cpu_variant_t;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CPU_X86
+// lets a function use the instructions of a variant, whatever the program is
+// compiled for
+#define CPU_TARGET_POPCNT_BMI2 __attribute__((target("popcnt,lzcnt,bmi,bmi2")))
+#define CPU_TARGET_AVX2                                                        \
+  __attribute__((target("avx2,popcnt,lzcnt,bmi,bmi2")))
+#define CPU_TARGET_AVX512                                                      \
+  __attribute__((target("avx512f,avx2,popcnt,lzcnt,bmi,bmi2")))
+#endif
+
+// a kernel body, inlined into the function compiled for each variant
+#define CPU_KERNEL static inline __attribute__((always_inline))
+
+/* name of each variant (as given to cpu_variant_parse) */
+extern const char *const cpu_variant_names[CPU_VARIANTS];
+
+/* whether this cpu can run the kernels of variant */
+bool cpu_supports(cpu_variant_t variant);
+
+/* the best variant this cpu supports */
+cpu_variant_t cpu_detect();
+
+/* parse a variant name, returns false if it isn't one */
+bool cpu_variant_parse(const char *name, cpu_variant_t *dst);
+
+/**
+ * Use the kernels of variant from now on (the cpu must support it)
+ * Until this is called, the kernels of cpu_detect() are used. It must not be
+ * called while other threads are using the kernels. */
+void cpu_select(cpu_variant_t variant);
+
+/* the variant in use */
+cpu_variant_t cpu_selected();
@@ -1,43 +1,120 @@
 #include "api.hpp"
 #include "bitboard.hpp"
+#include "cpu.hpp"
+#include "endgame.hpp"
 #include "hash_table.hpp"
 #include "minimax.hpp"
 #include "stats.hpp"
 #include <chrono>
+#include <csignal>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <thread>
 
+// how often the server is asked whether a move is needed (ms)
+#define DRIVER_POLL_MS 500
+// and while pondering, when every ms of waiting is search time taken from our
+// own clock
+#define DRIVER_PONDER_POLL_MS 10
+
 hash_table_t hash_table;
 api_config_t api_config;
+search_config_t search_config = {
+    1, false, false, ENDGAME_DEFAULT_EMPTIES, false, {0, 0, 0}, false, false,
+    false};
+ponder_t ponder;
+
+/* state kept for the game being played */
+typedef struct {
+  time_control_t time_control;
+  // number of pieces present on last board
+  int pieces_on_last_board;
+} game_t;
+
+// the game being played
+game_t game;
+// transposition table snapshot loaded at startup and saved between games (none
+// if nullptr)
+const char *snapshot_path = nullptr;
+// pattern weight file to evaluate with (the built in evaluation if nullptr)
+const char *eval_weights_path = nullptr;
+// network file to evaluate with instead (none if nullptr)
+const char *nnue_path = nullptr;
+// set by SIGINT / SIGTERM (with a snapshot), to save it before exiting
+volatile sig_atomic_t exit_requested = 0;
 
-void init_hash_table() {
-  srand(0);
-  hash_table_precalc();
-  hash_table_alloc(&hash_table);
+void init_hash_table(size_t megabytes) {
+  static const char *const pages[] = {"normal", "transparent huge", "huge"};
+  if (!hash_table_alloc(&hash_table, megabytes)) {
+    printf("Could not allocate a %zu MB transposition table\n", megabytes);
+    exit(1);
+  }
+  printf("Transposition table: %zu MB (%s pages)\n", megabytes,
+         pages[hash_table.pages]);
 }
 
-// number of pieces present on last board
-static int pieces_on_last_board = 4;
-void clear_hash_table_if_new_board(board_t *board, hash_table_t hash_table) {
-  int num_pieces = bits_popcount(board->players[0] | board->players[1]);
+void load_snapshot() {
+  if (snapshot_path == nullptr)
+    return;
+  int64_t entries = hash_table_load(hash_table, snapshot_path);
+  if (entries < 0) {
+    printf("No usable transposition table snapshot in %s\n", snapshot_path);
+  } else {
+    printf("Loaded %li entries from %s\n", (long)entries, snapshot_path);
+  }
+}
+
+/* save the table's deep entries (no search may be running) */
+void save_snapshot() {
+  if (snapshot_path == nullptr)
+    return;
+  auto start = std::chrono::steady_clock::now();
+  int64_t entries =
+      hash_table_save(hash_table, snapshot_path, HASH_SNAPSHOT_MIN_DEPTH);
+  if (entries < 0) {
+    printf("Could not save the transposition table to %s\n", snapshot_path);
+    return;
+  }
+  printf("Saved %li entries to %s in %li ms\n", (long)entries, snapshot_path,
+         (long)std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now() - start)
+             .count());
+}
 
-  if (abs(pieces_on_last_board - num_pieces) > 5)
-    hash_table_clear(hash_table);
+void request_exit(int) { exit_requested = 1; }
 
-  pieces_on_last_board = num_pieces;
+/* check whether board starts a new game (too many pieces were added or
+ * removed since the last board), and reset the game's time control if so */
+bool game_is_new(game_t *game, board_t *board) {
+  int num_pieces = bits_popcount(board->players[0] | board->players[1]);
+  bool is_new = abs(game->pieces_on_last_board - num_pieces) > 5;
+  if (is_new)
+    time_control_new_game(&game->time_control);
+
+  game->pieces_on_last_board = num_pieces;
+  return is_new;
 }
 
-move_t process_move(board_t *board, double search_time) {
-  stats_reset();
+move_t process_move(board_t *board) {
+  search_stats_t stats;
+  search_deadline_t deadline;
   printf("-------------------------------\n:: ");
   board_print_short(board);
   board_pretty_print(board);
-  hash_table_age(hash_table);
-  clear_hash_table_if_new_board(board, hash_table);
+  hash_table_age(&hash_table);
+  if (game_is_new(&game, board)) {
+    // keep what the last game found for later runs
+    save_snapshot();
+    hash_table_clear(&hash_table);
+  }
   // run minimax
+  time_control_allocate(&game.time_control, board, &deadline);
   move_t move;
-  int32_t score = get_move(&move, board, 0, hash_table, search_time);
+  int32_t score = get_move(&move, board, 0, hash_table, &deadline,
+                           &search_config, &stats);
+  time_control_used(&game.time_control,
+                    search_deadline_elapsed_ms(&deadline));
 
   char move_name[3];
   move_to_string(move_name, move);
@@ -47,34 +124,198 @@ move_t process_move(board_t *board, double search_time) {
     printf("Expected Distribution: %i-%i\n", 32 + piece_diff, 32 - piece_diff);
   }
   printf("\n");
-  stats_print(search_time);
+  stats_print(&stats, hash_table);
 
   return move;
 }
 
+void print_usage(const char *name) {
+  printf("Usage: %s [--threads N] [--pvs] [--aspiration] "
+         "[--endgame-empties N] [--ponder] [--game-time S] "
+         "[--probcut L[,L,L]] [--etc] [--stability] "
+         "[--cpu baseline|popcnt-bmi2|avx2|avx512] [--hash MB] "
+         "[--tt-file FILE] [--symmetry] [--eval-weights FILE | --nnue FILE] "
+         "URL KEY NAME SEARCH_TIME(s)\n",
+         name);
+  exit(1);
+}
+
+/* parse a selectivity level for all phases, or one for each phase (opening,
+ * midgame, endgame) separated by commas */
+void parse_probcut(const char *levels, const char *name) {
+  char *end;
+  for (int phase = 0; phase < PROBCUT_PHASES; phase++) {
+    long level = strtol(levels, &end, 10);
+    if (end == levels || level < 0 || level >= PROBCUT_LEVELS)
+      print_usage(name);
+    search_config.probcut[phase] = (int)level;
+    if (*end == '\0') {
+      // the last level given applies to the remaining phases
+      for (int rest = phase + 1; rest < PROBCUT_PHASES; rest++)
+        search_config.probcut[rest] = (int)level;
+      return;
+    }
+    if (*end != ',')
+      print_usage(name);
+    levels = end + 1;
+  }
+  // more levels than phases
+  print_usage(name);
+}
+
+/* parse --options out of argv, leaving the positional arguments in args
+ * return the number of positional arguments */
+int parse_args(int argc, char **argv, char **args, int max_args,
+               double *game_time, cpu_variant_t *cpu_variant,
+               bool *cpu_forced, size_t *hash_mb) {
+  int num_args = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      search_config.threads = (int)strtol(argv[++i], nullptr, 10);
+      if (search_config.threads < 1)
+        print_usage(argv[0]);
+    } else if (strcmp(argv[i], "--pvs") == 0) {
+      search_config.pvs = true;
+    } else if (strcmp(argv[i], "--aspiration") == 0) {
+      search_config.aspiration = true;
+    } else if (strcmp(argv[i], "--endgame-empties") == 0 && i + 1 < argc) {
+      search_config.endgame_empties = (int)strtol(argv[++i], nullptr, 10);
+    } else if (strcmp(argv[i], "--ponder") == 0) {
+      search_config.ponder = true;
+    } else if (strcmp(argv[i], "--game-time") == 0 && i + 1 < argc) {
+      *game_time = strtod(argv[++i], nullptr);
+    } else if (strcmp(argv[i], "--probcut") == 0 && i + 1 < argc) {
+      parse_probcut(argv[++i], argv[0]);
+    } else if (strcmp(argv[i], "--etc") == 0) {
+      search_config.etc = true;
+    } else if (strcmp(argv[i], "--stability") == 0) {
+      search_config.stability = true;
+    } else if (strcmp(argv[i], "--symmetry") == 0) {
+      search_config.symmetry = true;
+    } else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) {
+      if (!cpu_variant_parse(argv[++i], cpu_variant))
+        print_usage(argv[0]);
+      *cpu_forced = true;
+    } else if (strcmp(argv[i], "--hash") == 0 && i + 1 < argc) {
+      long megabytes = strtol(argv[++i], nullptr, 10);
+      // the table is made of whole buckets, and sized in powers of two
+      if (megabytes < 1 || (megabytes & (megabytes - 1)) != 0)
+        print_usage(argv[0]);
+      *hash_mb = (size_t)megabytes;
+    } else if (strcmp(argv[i], "--tt-file") == 0 && i + 1 < argc) {
+      snapshot_path = argv[++i];
+    } else if (strcmp(argv[i], "--eval-weights") == 0 && i + 1 < argc) {
+      eval_weights_path = argv[++i];
+    } else if (strcmp(argv[i], "--nnue") == 0 && i + 1 < argc) {
+      nnue_path = argv[++i];
+    } else if (strncmp(argv[i], "--", 2) == 0 || num_args >= max_args) {
+      print_usage(argv[0]);
+    } else {
+      args[num_args++] = argv[i];
+    }
+  }
+
+  return num_args;
+}
+
 int main(int argc, char **argv) {
-  if (argc != 5) {
-    printf("Usage: %s URL KEY NAME SEARCH_TIME(s)\n", argv[0]);
+  char *args[4];
+  double game_time = 0.0;
+  cpu_variant_t cpu_variant = cpu_detect();
+  bool cpu_forced = false;
+  size_t hash_mb = HASH_TABLE_DEFAULT_MB;
+  if (parse_args(argc, argv, args, 4, &game_time, &cpu_variant, &cpu_forced,
+                 &hash_mb) != 4) {
+    print_usage(argv[0]);
+  }
+  // there is one evaluation at a time
+  if (eval_weights_path != nullptr && nnue_path != nullptr) {
+    print_usage(argv[0]);
+  }
+  // the probcut parameters are fitted to the scores of the built in evaluation,
+  // and would make unsound cuts with the scale of pattern or network scores
+  bool probcut = false;
+  for (int phase = 0; phase < PROBCUT_PHASES; phase++)
+    probcut = probcut || search_config.probcut[phase] > 0;
+  if (probcut && (eval_weights_path != nullptr || nnue_path != nullptr)) {
+    printf("--probcut only works with the built in evaluation\n");
+    exit(1);
+  }
+  // forcing a variant the cpu can't run would crash on the first kernel call
+  if (!cpu_supports(cpu_variant)) {
+    printf("This CPU does not support the %s kernels\n",
+           cpu_variant_names[cpu_variant]);
     exit(1);
   }
-  api_config.url = argv[1];
-  api_config.key = argv[2];
+  cpu_select(cpu_variant);
+  printf("Using the %s kernels (%s)\n", cpu_variant_names[cpu_variant],
+         cpu_forced ? "forced" : "detected");
+
+  api_config.url = args[0];
+  api_config.key = args[1];
+
+  // before the snapshot, which only loads if it was made with the same
+  // evaluation
+  if (eval_weights_path != nullptr) {
+    if (!evaluator_load_patterns(eval_weights_path)) {
+      printf("Could not load pattern weights from %s\n", eval_weights_path);
+      exit(1);
+    }
+    printf("Evaluating with the pattern weights in %s\n", eval_weights_path);
+  }
+  if (nnue_path != nullptr) {
+    if (!evaluator_load_nnue(nnue_path)) {
+      printf("Could not load a network from %s\n", nnue_path);
+      exit(1);
+    }
+    printf("Evaluating with the network in %s\n", nnue_path);
+  }
 
-  init_hash_table();
-  hash_table_clear(hash_table);
+  init_hash_table(hash_mb);
+  load_snapshot();
+  // with a snapshot, finish the current move and save it before exiting
+  if (snapshot_path != nullptr) {
+    signal(SIGINT, request_exit);
+    signal(SIGTERM, request_exit);
+  }
 
-  api_set_name(&api_config, argv[3]);
-  double search_time = (double)strtol(argv[4], nullptr, 10);
+  api_set_name(&api_config, args[2]);
+  time_control_init(&game.time_control, strtod(args[3], nullptr), game_time);
+  game.pieces_on_last_board = 4;
 
-  while (true) {
+  bool pondering = false;
+  while (!exit_requested) {
     if (!api_move_needed(&api_config)) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(500));
+      std::this_thread::sleep_for(std::chrono::milliseconds(
+          pondering ? DRIVER_PONDER_POLL_MS : DRIVER_POLL_MS));
       continue;
     }
 
+    if (pondering) {
+      ponder_stop(&ponder);
+      pondering = false;
+      printf("Pondered: depth %li, ", ponder.stats.minimax_depth);
+      pprint_num((double)ponder.stats.boards_visited);
+      printf(" boards\n");
+    }
+
     board_t board;
     api_board(&api_config, &board);
-    move_t move = process_move(&board, search_time);
+    move_t move = process_move(&board);
     api_do_move(&api_config, move);
+
+    // search the opponent's replies until our next move is needed
+    if (search_config.ponder) {
+      board_make_move(&board, move, 0);
+      if (board_gen_moves(&board, 1)) {
+        ponder_start(&ponder, &board, 1, hash_table, &search_config);
+        pondering = true;
+      }
+    }
   }
+
+  if (pondering)
+    ponder_stop(&ponder);
+  save_snapshot();
+  return 0;
 }
@@ -0,0 +1,509 @@
+#include "endgame.hpp"
+#include "evaluator.hpp"
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+// at or below this many empties, squares are tried directly instead of
+// generating moves, and the time isn't checked
+#define ENDGAME_SMALL_EMPTIES 4
+// above this many empties, moves are sorted fastest first
+#define ENDGAME_SORT_EMPTIES 6
+// at or above this many empties, nodes use the transposition table
+#define ENDGAME_TT_EMPTIES 10
+// at or above this many empties, nodes may be split between threads
+#define ENDGAME_SPLIT_EMPTIES 12
+// at or above this many empties, children are looked up in the table before
+// any of them is searched (so that they are in the table themselves)
+#define ENDGAME_ETC_EMPTIES (ENDGAME_TT_EMPTIES + 1)
+// at or above this many empties, the opponent's stable pieces are counted
+#define ENDGAME_STABILITY_EMPTIES 8
+// larger than any piece difference
+#define ENDGAME_INF 65
+
+#define ENDGAME_CORNERS 0x8100000000000081
+
+// quadrants of the board, used for parity ordering
+static const bitboard_t endgame_quadrants[4] = {
+    0x000000000f0f0f0f, 0x00000000f0f0f0f0, 0x0f0f0f0f00000000,
+    0xf0f0f0f000000000};
+
+/* squares in quadrants with an odd number of empties
+ * moving into an odd region tends to leave us the last move in it */
+static inline bitboard_t endgame_odd_regions(bitboard_t empty) {
+  bitboard_t odd = 0;
+  for (int q = 0; q < 4; q++) {
+    if (bits_popcount(empty & endgame_quadrants[q]) & 1)
+      odd |= endgame_quadrants[q];
+  }
+  return odd;
+}
+
+static inline int endgame_piece_diff(board_t *board, color_t player) {
+  return bits_popcount(board->players[player]) -
+         bits_popcount(board->players[!player]);
+}
+
+static inline void endgame_count_board(search_thread_t *thread) {
+#ifdef COUNT_STATS
+  thread->stats.boards_visited++;
+  thread->stats.endgame_boards++;
+#endif
+}
+
+/* final score with only square sq left empty */
+static inline int endgame_last_1(search_thread_t *thread, board_t *board,
+                                 color_t player, move_t sq) {
+  endgame_count_board(thread);
+  int diff = endgame_piece_diff(board, player);
+
+  auto flips = board_gen_flips(board, sq, player);
+  if (flips) {
+    return diff + 1 + 2 * bits_popcount(flips);
+  }
+  flips = board_gen_flips(board, sq, !player);
+  if (flips) {
+    return diff - 1 - 2 * bits_popcount(flips);
+  }
+  return diff;
+}
+
+/* solve a board with 2 to ENDGAME_SMALL_EMPTIES empties
+ * empty squares are tried in parity order, without generating moves */
+static int endgame_last_n(search_thread_t *thread, board_t *board,
+                          color_t player, int alpha, int beta, bool passed) {
+  endgame_count_board(thread);
+  auto empty = ~(board->players[0] | board->players[1]);
+  auto odd = endgame_odd_regions(empty);
+  bitboard_t order[2] = {empty & odd, empty & ~odd};
+
+  int best = -ENDGAME_INF;
+  for (int i = 0; i < 2; i++) {
+    auto squares = order[i];
+    while (squares) {
+      move_t sq = bitboard_get_and_clear_first_move(&squares);
+      auto flips = board_gen_flips(board, sq, player);
+      if (!flips)
+        continue;
+
+      board_t child = *board;
+      child.players[player] |= flips | (1ULL << sq);
+      child.players[!player] &= ~flips;
+
+      auto rest = empty & ~(1ULL << sq);
+      int score;
+      if (bits_popcount(rest) == 1) {
+        score = -endgame_last_1(thread, &child, !player,
+                                bits_index_of_first_set(rest));
+      } else {
+        score = -endgame_last_n(thread, &child, !player, -beta, -alpha, false);
+      }
+
+      if (score > best) {
+        best = score;
+        alpha = std::max(alpha, score);
+        if (alpha >= beta)
+          return best;
+      }
+    }
+  }
+
+  // no legal moves, so pass (or the game is over)
+  if (best == -ENDGAME_INF) {
+    if (passed)
+      return endgame_piece_diff(board, player);
+    return -endgame_last_n(thread, board, !player, -beta, -alpha, true);
+  }
+
+  return best;
+}
+
+static int endgame_search(search_thread_t *thread, move_t *dst_best_move,
+                          board_t *board, uint64_t hash, color_t player,
+                          int alpha, int beta, bool passed);
+
+/* search one sibling of a split point, and merge its score */
+static void endgame_split_run(search_thread_t *thread, split_task_t *task) {
+  split_point_t *split = task->split;
+  split_point_t *saved_split = thread->split;
+  thread->split = split;
+  // the thread's own search may have been aborted already, which has nothing
+  // to do with the task (the task may belong to another thread)
+  bool saved_aborted = thread->aborted;
+  thread->aborted = false;
+
+  if (!split_is_cut(split)) {
+    int alpha = split->alpha.load(std::memory_order_relaxed);
+    int beta = split->beta;
+    board_t child = split->children[task->index];
+    uint64_t hash = split->hashes[task->index];
+    color_t player = split->player;
+    int score = -endgame_search(thread, nullptr, &child, hash, !player,
+                                -alpha - 1, -alpha, false);
+    if (score > alpha && score < beta && !thread->aborted) {
+      alpha = split->alpha.load(std::memory_order_relaxed);
+      score = -endgame_search(thread, nullptr, &child, hash, !player, -beta,
+                              -alpha, false);
+    }
+
+    if (thread->aborted) {
+      // a sibling failing high decides the node, so only stopping for any
+      // other reason leaves it incomplete
+      if (!split->cut.load(std::memory_order_acquire))
+        split->aborted.store(true, std::memory_order_relaxed);
+    } else {
+      std::lock_guard<std::mutex> guard(split->lock);
+      if (score > split->best) {
+        split->best = score;
+        split->best_move = split->moves[task->index];
+        if (score > split->alpha.load(std::memory_order_relaxed))
+          split->alpha.store(score, std::memory_order_relaxed);
+        if (score >= beta)
+          split->cut.store(true, std::memory_order_release);
+      }
+    }
+  }
+
+  // back to the thread's own search, which is also aborted if the search was
+  // stopped or a split point above it was cut meanwhile
+  thread->split = saved_split;
+  thread->aborted = saved_aborted ||
+                    thread->stop->load(std::memory_order_relaxed) ||
+                    split_is_cut(saved_split);
+  split->pending.fetch_sub(1, std::memory_order_release);
+}
+
+/* search the younger siblings children[first..n) in parallel, and merge their
+ * scores into best and best_move
+ * returns once every sibling is done, helping with other tasks meanwhile */
+static void endgame_split(search_thread_t *thread, color_t player,
+                          const board_t *children, const uint64_t *hashes,
+                          const move_t *moves, int first, int n, int alpha,
+                          int beta, int *best, move_t *best_move) {
+#ifdef COUNT_STATS
+  thread->stats.endgame_splits++;
+#endif
+  split_point_t split;
+  split.parent = thread->split;
+  split.player = player;
+  split.children = children;
+  split.hashes = hashes;
+  split.moves = moves;
+  split.beta = beta;
+  split.alpha.store(alpha, std::memory_order_relaxed);
+  split.cut.store(false, std::memory_order_relaxed);
+  split.aborted.store(false, std::memory_order_relaxed);
+  split.pending.store(n - first, std::memory_order_relaxed);
+  split.best = *best;
+  split.best_move = *best_move;
+
+  // pushed in reverse, so the owner pops them in move order
+  for (int i = n - 1; i >= first; i--) {
+    split_push(thread->pool, thread->id, {&split, i});
+  }
+
+  while (split.pending.load(std::memory_order_acquire) > 0) {
+    split_task_t task;
+    if (split_pop(thread->pool, thread->id, &task)) {
+      endgame_split_run(thread, &task);
+    } else if (split_steal(thread->pool, thread->id, &task)) {
+#ifdef COUNT_STATS
+      thread->stats.endgame_steals++;
+#endif
+      endgame_split_run(thread, &task);
+    } else {
+      // thread 0 keeps checking the clock while it waits, as the deadline
+      // stops the threads searching the siblings
+      search_thread_poll(thread);
+      std::this_thread::yield();
+    }
+  }
+
+  // siblings stopped by the deadline, a cut above the node or the search being
+  // stopped didn't report their scores, so the node's result is incomplete
+  if (split.aborted.load(std::memory_order_relaxed) ||
+      thread->stop->load(std::memory_order_relaxed) ||
+      split_is_cut(split.parent)) {
+    thread->aborted = true;
+  }
+  *best = split.best;
+  *best_move = split.best_move;
+}
+
+/* hash is only used (and only needs to be right) with at least
+ * ENDGAME_TT_EMPTIES empties */
+static int endgame_search(search_thread_t *thread, move_t *dst_best_move,
+                          board_t *board, uint64_t hash, color_t player,
+                          int alpha, int beta, bool passed) {
+  auto empty = ~(board->players[0] | board->players[1]);
+  int empties = bits_popcount(empty);
+  if (empties <= ENDGAME_SMALL_EMPTIES && dst_best_move == nullptr) {
+    if (empties == 0)
+      return endgame_piece_diff(board, player);
+    if (empties == 1)
+      return endgame_last_1(thread, board, player,
+                            bits_index_of_first_set(empty));
+    return endgame_last_n(thread, board, player, alpha, beta, passed);
+  }
+
+  if (search_thread_poll(thread)) {
+    return 0;
+  }
+  endgame_count_board(thread);
+
+  auto moves = board_gen_moves(board, player);
+  if (!moves) {
+    if (passed)
+      return endgame_piece_diff(board, player);
+    // pass nodes don't use the table, as the board is the same as the child's
+    return -endgame_search(thread, nullptr, board, hash_pass(hash), !player,
+                           -beta, -alpha, true);
+  }
+
+  // we can't end up with more than the pieces the opponent can't take back
+  if (thread->config->stability && dst_best_move == nullptr &&
+      empties >= ENDGAME_STABILITY_EMPTIES &&
+      64 - 2 * bits_popcount(board->players[!player]) <= alpha) {
+    int bound = 64 - 2 * bits_popcount(board_gen_stable(board, !player));
+    if (bound <= alpha) {
+#ifdef COUNT_STATS
+      thread->stats.stability_cutoffs++;
+#endif
+      return bound;
+    }
+  }
+
+  move_t tt_move = 255;
+  bool use_tt = empties >= ENDGAME_TT_EMPTIES;
+  int symmetry = 0;
+  uint64_t key = 0;
+  if (use_tt) {
+    key = search_table_key(thread, board, hash, player, &symmetry);
+    hash_entry_t entry;
+    bool hit = search_table_lookup(thread, key, symmetry, &entry);
+#ifdef COUNT_STATS
+    thread->stats.table_probes++;
+    thread->stats.table_hits += hit;
+#endif
+    if (hit) {
+      // entries from minimax are still good for ordering
+      tt_move = entry.best_move;
+      if (entry.depth >= ENDGAME_TT_DEPTH && entry.best_move < 64 &&
+          (moves & (1ULL << entry.best_move))) {
+        int value = entry.value / EVAL_INF;
+        if (entry.flags & BOUND_TYPE_EXACT) {
+          alpha = beta = value;
+        } else if (entry.flags & BOUND_TYPE_LOWERBOUND) {
+          alpha = std::max(alpha, value);
+        } else if (entry.flags & BOUND_TYPE_UPERBOUND) {
+          beta = std::min(beta, value);
+        }
+        if (alpha >= beta) {
+#ifdef COUNT_STATS
+          thread->stats.boards_direct_table_hits++;
+#endif
+          if (dst_best_move != nullptr)
+            *dst_best_move = entry.best_move;
+          return value;
+        }
+      }
+    }
+  }
+  // (after the table lookup, as a score at or below a lower bound the table
+  // raised alpha to is only an upper bound)
+  int orig_alpha = alpha;
+
+  // make each move, and sort them so the most promising come first
+  // (table move, then fewest replies for the opponent, then parity)
+  move_t list[64];
+  board_t children[64];
+  uint64_t hashes[64];
+  int keys[64];
+  int n = 0;
+  auto odd = endgame_odd_regions(empty);
+  bool sort_fastest_first = empties > ENDGAME_SORT_EMPTIES;
+  bool use_etc = thread->config->etc && empties >= ENDGAME_ETC_EMPTIES;
+  while (moves) {
+    move_t move = bitboard_get_and_clear_first_move(&moves);
+    bitboard_t move_bit = 1ULL << move;
+    board_t child = *board;
+    auto flips = board_gen_flips(board, move, player);
+    child.players[player] |= flips | move_bit;
+    child.players[!player] &= ~flips;
+    // the child's table entry is looked up below (with etc), or once the
+    // child is searched
+    uint64_t child_hash = 0;
+    if (empties > ENDGAME_TT_EMPTIES) {
+      child_hash = hash_move(hash, move, flips, player);
+      // (a symmetric key isn't known yet)
+      if (!search_symmetric_key(thread, &child))
+        hash_table_prefetch(thread->hash_table, child_hash);
+    }
+
+    int key = (odd & move_bit) ? 0 : 1;
+    if (sort_fastest_first) {
+      auto replies = board_gen_moves(&child, !player);
+      key = 16 * bits_popcount(replies) + 4 * key -
+            ((move_bit & ENDGAME_CORNERS) ? 8 : 0);
+
+      // enhanced transposition cutoff: the child is already known to be at
+      // least beta for us (pass nodes aren't in the table)
+      hash_entry_t entry;
+      bool refutes = false;
+      if (use_etc && replies) {
+        int child_symmetry;
+        uint64_t child_key = search_table_key(thread, &child, child_hash,
+                                              !player, &child_symmetry);
+        refutes =
+            search_table_lookup(thread, child_key, child_symmetry, &entry) &&
+            entry.depth >= ENDGAME_TT_DEPTH && entry.best_move < 64 &&
+            (replies & (1ULL << entry.best_move)) &&
+            (entry.flags & (BOUND_TYPE_EXACT | BOUND_TYPE_UPERBOUND)) &&
+            -entry.value / EVAL_INF >= beta;
+      }
+      if (refutes) {
+#ifdef COUNT_STATS
+        thread->stats.etc_cutoffs++;
+#endif
+        if (dst_best_move != nullptr)
+          *dst_best_move = move;
+        return -entry.value / EVAL_INF;
+      }
+    }
+    if (move == tt_move) {
+      key = -ENDGAME_INF * 16;
+    }
+
+    int i = n++;
+    for (; i > 0 && keys[i - 1] > key; i--) {
+      list[i] = list[i - 1];
+      children[i] = children[i - 1];
+      hashes[i] = hashes[i - 1];
+      keys[i] = keys[i - 1];
+    }
+    list[i] = move;
+    children[i] = child;
+    hashes[i] = child_hash;
+    keys[i] = key;
+  }
+
+  int best = -ENDGAME_INF;
+  move_t best_move = 255;
+  bool can_split = thread->pool != nullptr && empties >= ENDGAME_SPLIT_EMPTIES;
+  for (int i = 0; i < n; i++) {
+    // young brothers wait: once the eldest child is searched (and didn't cut
+    // off), the rest can be searched in parallel
+    if (i == 1 && can_split && n > 2) {
+      endgame_split(thread, player, children, hashes, list, 1, n, alpha, beta,
+                    &best, &best_move);
+      if (thread->aborted) {
+        return 0;
+      }
+      break;
+    }
+
+    int score;
+    if (i == 0) {
+      score = -endgame_search(thread, nullptr, &children[i], hashes[i],
+                              !player, -beta, -alpha, false);
+    } else {
+      // null window first, as the first move is usually the best
+      score = -endgame_search(thread, nullptr, &children[i], hashes[i],
+                              !player, -alpha - 1, -alpha, false);
+      if (score > alpha && score < beta) {
+        score = -endgame_search(thread, nullptr, &children[i], hashes[i],
+                                !player, -beta, -alpha, false);
+      }
+    }
+    if (thread->aborted) {
+      return 0;
+    }
+
+    if (score > best) {
+      best = score;
+      best_move = list[i];
+      alpha = std::max(alpha, score);
+      if (alpha >= beta)
+        break;
+    }
+  }
+
+  if (use_tt) {
+    hash_entry_t new_entry;
+    new_entry.hash = key;
+    new_entry.value = best * EVAL_INF;
+    new_entry.depth = ENDGAME_TT_DEPTH;
+    new_entry.best_move = best_move < 64 ? move_transform(best_move, symmetry)
+                                         : best_move;
+    new_entry.flags = HASH_TABLE_FLAGS_USED;
+    if (best <= orig_alpha) {
+      new_entry.flags |= BOUND_TYPE_UPERBOUND;
+    } else if (best >= beta) {
+      new_entry.flags |= BOUND_TYPE_LOWERBOUND;
+    } else {
+      new_entry.flags |= BOUND_TYPE_EXACT;
+    }
+    hash_table_insert(thread->hash_table, &new_entry);
+  }
+
+  if (dst_best_move != nullptr)
+    *dst_best_move = best_move;
+  return best;
+}
+
+void endgame_split_worker(search_thread_t *thread) {
+  while (!thread->stop->load(std::memory_order_relaxed)) {
+    split_task_t task;
+    if (split_steal(thread->pool, thread->id, &task)) {
+#ifdef COUNT_STATS
+      thread->stats.endgame_steals++;
+#endif
+      endgame_split_run(thread, &task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+/* convert a minimax bound to piece difference (rounding outwards) */
+static inline int endgame_floor_bound(int32_t value) {
+  if (value <= -ENDGAME_INF * EVAL_INF)
+    return -ENDGAME_INF;
+  if (value >= ENDGAME_INF * EVAL_INF)
+    return ENDGAME_INF;
+  return value >= 0 ? value / EVAL_INF : -((-value + EVAL_INF - 1) / EVAL_INF);
+}
+
+static inline int endgame_ceil_bound(int32_t value) {
+  return -endgame_floor_bound(-value);
+}
+
+int32_t endgame_solve(search_thread_t *thread, move_t *dst_best_move,
+                      board_t *board, uint64_t hash, color_t player,
+                      int32_t alpha, int32_t beta) {
+#ifdef COUNT_STATS
+  thread->stats.endgame_solves++;
+#endif
+  int a = endgame_floor_bound(alpha);
+  int b = endgame_ceil_bound(beta);
+
+  // with a wide window, first find out whether the game is won, lost or drawn
+  // with a null window around 0, then solve exactly on that side of 0
+  if (a < 0 && b > 0 && b - a > 2) {
+    int wld = endgame_search(thread, dst_best_move, board, hash, player, -1, 1,
+                             false);
+    if (thread->aborted) {
+      return 0;
+    } else if (wld == 0) {
+      return 0;
+    } else if (wld > 0) {
+      a = wld - 1;
+    } else {
+      b = wld + 1;
+    }
+  }
+
+  return endgame_search(thread, dst_best_move, board, hash, player, a, b,
+                        false) *
+         EVAL_INF;
+}
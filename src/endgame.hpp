@@ -0,0 +1,41 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include "search.hpp"
+#include <cstdint>
+
+/**
+ * Endgame Solver
+ * Once minimax would search to the end of the game anyway, the rest of the
+ * game is handed to an exact solver. It doesn't use the evaluation function,
+ * only uses the transposition table far from the leaves, orders moves by
+ * fewest opponent replies (fastest first) and region parity, and solves the
+ * last four empty squares without generating moves.
+ *
+ * With more than one thread, a root within the solver's reach is solved with
+ * young brothers wait splitting instead of lazy smp: thread 0 searches the
+ * tree, and splits nodes far enough from the leaves after their eldest child
+ * is searched. The other threads only steal and search younger siblings.
+ */
+
+// default number of empty squares at which the solver takes over
+#define ENDGAME_DEFAULT_EMPTIES 20
+// depth the iterative deepening searches to before solving, so that the
+// solver starts with ordered moves in the table
+#define ENDGAME_PRESEARCH_DEPTH 8
+// table depth given to solved entries (deeper than any search)
+#define ENDGAME_TT_DEPTH 64
+
+/**
+ * Solve the board exactly, with player to move (hash is its hash_board).
+ * The result is the final piece difference from player's point of view scaled
+ * by EVAL_INF (as with evaluate_is_terminal). alpha and beta use the same
+ * scale, and the result is fail soft with respect to them.
+ * If dst_best_move isn't null, the best move is written to it (player must
+ * have a legal move) */
+int32_t endgame_solve(search_thread_t *thread, move_t *dst_best_move,
+                      board_t *board, uint64_t hash, color_t player,
+                      int32_t alpha, int32_t beta);
+
+/* steal and search siblings from split nodes until the search is stopped */
+void endgame_split_worker(search_thread_t *thread);
@@ -0,0 +1,181 @@
+#include "bitboard.hpp"
+#include "evaluator.hpp"
+#include "hash_table.hpp"
+#include "minimax.hpp"
+#include "stats.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+/**
+ * Endgame solver benchmark
+ * Solves a fixed set of 20 to 24 empty positions with each of the given thread
+ * counts (from an empty table each time), and reports the time and speedup
+ * over the first thread count. The scores must agree across thread counts.
+ *
+ * With --game-time S, each position is then also searched by the largest
+ * thread count under the time allocation of a game of S seconds, which usually
+ * stops it at the hard deadline in the middle of the solve, and solved again
+ * with the table that search left behind. An aborted search must neither
+ * overrun its deadline by much nor leave wrong entries in the table, so the
+ * second solve has to agree with the first thread count's. */
+
+// a timed search may stop this much after its hard deadline (ms)
+#define ENDGAME_BENCH_DEADLINE_SLACK_MS 50
+
+/* pieces of the player to move, then of the opponent */
+static const bitboard_t endgame_bench_positions[][2] = {
+    {0x128c487138221228ULL, 0x2460b70e45dc0c04ULL}, /* 20 empties */
+    {0x407878c8a4522201ULL, 0xbc0607171b040c14ULL}, /* 20 empties */
+    {0x0c008240307c3804ULL, 0x837f3dbd0e0040c0ULL}, /* 21 empties */
+    {0xe87c6056ea020000ULL, 0x00809028143c7fe4ULL}, /* 21 empties */
+    {0x001e125a1e0a3100ULL, 0x00206ca0e0a4ccfaULL}, /* 22 empties */
+    {0x100f070d1d130311ULL, 0x00707072e02c3820ULL}, /* 22 empties */
+    {0x41003410617e0100ULL, 0x16ff4b6f1c002000ULL}, /* 23 empties */
+    {0x540c160641505118ULL, 0x007309383e2e2220ULL}, /* 23 empties */
+    {0x04a0e0c0824c1c00ULL, 0x181e1e3c78302038ULL}, /* 24 empties */
+};
+#define ENDGAME_BENCH_POSITIONS                                                \
+  (int)(sizeof(endgame_bench_positions) / sizeof(endgame_bench_positions[0]))
+
+int main(int argc, char **argv) {
+  std::vector<int> thread_counts;
+  double game_time = 0.0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--game-time") == 0 && i + 1 < argc) {
+      game_time = strtod(argv[++i], nullptr);
+      if (game_time > 0.0)
+        continue;
+      // otherwise the time is rejected like a thread count below
+    }
+    int threads = (int)strtol(argv[i], nullptr, 10);
+    if (threads < 1) {
+      printf("Usage: %s [--game-time S] [THREADS...]\n", argv[0]);
+      return 1;
+    }
+    thread_counts.push_back(threads);
+  }
+  if (thread_counts.empty()) {
+    int cores = std::max((int)std::thread::hardware_concurrency(), 1);
+    for (int threads = 1; threads < cores; threads *= 2)
+      thread_counts.push_back(threads);
+    thread_counts.push_back(cores);
+  }
+
+  hash_table_t hash_table;
+  if (!hash_table_alloc(&hash_table, HASH_TABLE_DEFAULT_MB)) {
+    printf("Could not allocate the transposition table\n");
+    return 1;
+  }
+
+  std::vector<double> total_time(thread_counts.size(), 0.0);
+  std::vector<int32_t> scores(ENDGAME_BENCH_POSITIONS);
+  std::vector<int64_t> total_boards(thread_counts.size(), 0);
+  bool mismatch = false;
+
+  printf("Position  Empties");
+  for (int threads : thread_counts)
+    printf("  %3i thr (s)", threads);
+  printf("  Score\n");
+
+  for (int p = 0; p < ENDGAME_BENCH_POSITIONS; p++) {
+    board_t board;
+    board.players[0] = endgame_bench_positions[p][0];
+    board.players[1] = endgame_bench_positions[p][1];
+    int empties = 64 - bits_popcount(board.players[0] | board.players[1]);
+    printf("%8i  %7i", p, empties);
+    fflush(stdout);
+
+    int32_t first_score = 0;
+    for (size_t t = 0; t < thread_counts.size(); t++) {
+      search_config_t config = {thread_counts[t], true,  false, empties,
+                                false,            {0, 0, 0}, false, false,
+                                false};
+      search_stats_t stats;
+      hash_table_clear(&hash_table);
+
+      auto start = std::chrono::steady_clock::now();
+      int32_t score =
+          search_depth(&board, 0, hash_table, empties, &config, &stats);
+      double time = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+
+      total_time[t] += time;
+      total_boards[t] += stats.boards_visited;
+      if (t == 0) {
+        first_score = score;
+      } else if (score != first_score) {
+        mismatch = true;
+      }
+      printf("  %11.3lf", time);
+      fflush(stdout);
+    }
+    scores[p] = first_score;
+    printf("  %+5i\n", first_score / EVAL_INF);
+  }
+
+  printf("\nThreads  Time (s)  Speedup  Boards      Boards/s\n");
+  for (size_t t = 0; t < thread_counts.size(); t++) {
+    printf("%7i  %8.3lf  %7.2lf  ", thread_counts[t], total_time[t],
+           total_time[0] / total_time[t]);
+    pprint_num((double)total_boards[t]);
+    printf("  ");
+    pprint_num((double)total_boards[t] / total_time[t]);
+    printf("/s\n");
+  }
+
+  if (game_time > 0.0) {
+    int threads = *std::max_element(thread_counts.begin(), thread_counts.end());
+    printf("\nTimed searches (%.2lf s game, %i threads), then solves on the "
+           "same table\n",
+           game_time, threads);
+    printf("Position  Deadline (ms)  Used (ms)  Score\n");
+    for (int p = 0; p < ENDGAME_BENCH_POSITIONS; p++) {
+      board_t board;
+      board.players[0] = endgame_bench_positions[p][0];
+      board.players[1] = endgame_bench_positions[p][1];
+      int empties = 64 - bits_popcount(board.players[0] | board.players[1]);
+      search_config_t config = {threads, true,      false, empties, false,
+                                {0, 0, 0}, false, false,   false};
+      search_stats_t stats;
+      hash_table_clear(&hash_table);
+
+      time_control_t control;
+      time_control_init(&control, 0.0, game_time);
+      search_deadline_t deadline;
+      time_control_allocate(&control, &board, &deadline);
+      move_t move;
+      get_move(&move, &board, 0, hash_table, &deadline, &config, &stats);
+      auto used = search_deadline_elapsed_ms(&deadline);
+      auto allowed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         deadline.hard_deadline - deadline.start)
+                         .count();
+
+      int32_t score =
+          search_depth(&board, 0, hash_table, empties, &config, &stats);
+      printf("%8i  %13lli  %9lli  %+5i", p, (long long)allowed,
+             (long long)used, score / EVAL_INF);
+      if (used > allowed + ENDGAME_BENCH_DEADLINE_SLACK_MS) {
+        printf("  deadline overrun");
+        mismatch = true;
+      }
+      if (score != scores[p]) {
+        printf("  expected %+i", scores[p] / EVAL_INF);
+        mismatch = true;
+      }
+      printf("\n");
+    }
+  }
+
+  if (mismatch) {
+    printf("\nScores differ between thread counts (or a timed search went "
+           "wrong)\n");
+    return 1;
+  }
+  return 0;
+}
@@ -1,4 +1,5 @@
 #include "evaluator.hpp"
+#include "pattern.hpp"
 #include <cassert>
 
 // evaluate board position based purely on material
@@ -43,22 +44,19 @@ int32_t evaluate_is_terminal(board_t *board, bitboard_t player0_moves,
   return 0;
 }
 
-#define CORNERS 0x8100000000000081
-#define AVOID_CORNERS_1 0x0042000000004200
-#define AVOID_CORNERS_2 0x4281000000008142
+static inline int32_t evaluate_corners(board_t *board) {
 
-int32_t evaluate_corners(board_t *board) {
-
-  return +(10 * bits_popcount(board->players[0] & CORNERS)) -
-         (10 * bits_popcount(board->players[1] & CORNERS)) +
-         (-2 * bits_popcount(board->players[0] & AVOID_CORNERS_1)) -
-         (-2 * bits_popcount(board->players[1] & AVOID_CORNERS_1)) +
-         (-1 * bits_popcount(board->players[0] & AVOID_CORNERS_2)) -
-         (-1 * bits_popcount(board->players[1] & AVOID_CORNERS_2));
+  return +(10 * bits_popcount(board->players[0] & BOARD_CORNERS)) -
+         (10 * bits_popcount(board->players[1] & BOARD_CORNERS)) +
+         (-2 * bits_popcount(board->players[0] & BOARD_X_SQUARES)) -
+         (-2 * bits_popcount(board->players[1] & BOARD_X_SQUARES)) +
+         (-1 * bits_popcount(board->players[0] & BOARD_C_SQUARES)) -
+         (-1 * bits_popcount(board->players[1] & BOARD_C_SQUARES));
 }
 
-int32_t evaluate_board(board_t *board, bitboard_t player0_moves,
-                       bitboard_t player1_moves) {
+CPU_KERNEL int32_t evaluate_board_kernel(board_t *board,
+                                         bitboard_t player0_moves,
+                                         bitboard_t player1_moves) {
   int32_t value = 4 * evaluate_mobility(board, player0_moves, player1_moves) +
                   4 * evaluate_corners(board);
 
@@ -71,3 +69,142 @@ int32_t evaluate_board(board_t *board, bitboard_t player0_moves,
 
   return value;
 }
+
+/* evaluate_board_kernel, from the features of a board that isn't won or lost */
+static inline int32_t evaluate_features(const board_features_t *features) {
+  int32_t value =
+      4 * (features->mobility[0] - features->mobility[1]) +
+      4 * (10 * (features->corners[0] - features->corners[1]) -
+           2 * (features->x_squares[0] - features->x_squares[1]) -
+           (features->c_squares[0] - features->c_squares[1]));
+
+  // during the midgame, minimize frontiers
+  if (64 - features->empties < 40) {
+    value += -features->frontier_count[0] + features->frontier_count[1];
+  }
+
+  return value;
+}
+
+/* --- kernel dispatch ---
+ * The evaluation is mostly popcounts, so the avx2 and avx-512 variants use the
+ * popcnt kernel (there is nothing for wider vectors to do) */
+
+typedef int32_t (*evaluate_board_t)(board_t *board, bitboard_t player0_moves,
+                                    bitboard_t player1_moves);
+
+static int32_t evaluate_board_baseline(board_t *board, bitboard_t player0_moves,
+                                       bitboard_t player1_moves) {
+  return evaluate_board_kernel(board, player0_moves, player1_moves);
+}
+
+#ifdef CPU_X86
+CPU_TARGET_POPCNT_BMI2 static int32_t
+evaluate_board_popcnt(board_t *board, bitboard_t player0_moves,
+                      bitboard_t player1_moves) {
+  return evaluate_board_kernel(board, player0_moves, player1_moves);
+}
+
+static const evaluate_board_t evaluate_board_variants[CPU_VARIANTS] = {
+    evaluate_board_baseline, evaluate_board_popcnt, evaluate_board_popcnt,
+    evaluate_board_popcnt};
+#else
+static const evaluate_board_t evaluate_board_variants[CPU_VARIANTS] = {
+    evaluate_board_baseline, evaluate_board_baseline, evaluate_board_baseline,
+    evaluate_board_baseline};
+#endif
+
+static evaluate_board_t evaluate_board_selected =
+    evaluate_board_variants[cpu_detect()];
+static pattern_evaluate_t pattern_evaluate_selected =
+    pattern_kernel(cpu_detect());
+
+// the pattern weights in use, nullptr for the built in evaluation
+static const int16_t *pattern_weights = nullptr;
+static uint32_t pattern_weights_checksum = 0;
+// the network in use (never at the same time as pattern weights)
+static const nnue_t *nnue_net = nullptr;
+static uint32_t nnue_net_checksum = 0;
+
+void evaluator_select_kernels(cpu_variant_t variant) {
+  evaluate_board_selected = evaluate_board_variants[variant];
+  pattern_evaluate_selected = pattern_kernel(variant);
+  nnue_select_kernels(variant);
+}
+
+void evaluator_use_patterns(const int16_t *weights) {
+  pattern_weights = weights;
+  if (weights != nullptr) {
+    pattern_weights_checksum = pattern_checksum(weights);
+    nnue_net = nullptr;
+  }
+}
+
+bool evaluator_load_patterns(const char *path) {
+  const int16_t *weights = pattern_load(path);
+  if (weights == nullptr)
+    return false;
+  evaluator_use_patterns(weights);
+  return true;
+}
+
+void evaluator_use_nnue(const nnue_t *net) {
+  nnue_net = net;
+  if (net != nullptr) {
+    nnue_net_checksum = nnue_checksum(net);
+    pattern_weights = nullptr;
+  }
+}
+
+bool evaluator_load_nnue(const char *path) {
+  const nnue_t *net = nnue_load(path);
+  if (net == nullptr)
+    return false;
+  evaluator_use_nnue(net);
+  return true;
+}
+
+const nnue_t *evaluator_nnue() { return nnue_net; }
+
+uint32_t evaluator_version() {
+  if (nnue_net != nullptr)
+    return nnue_net_checksum;
+  return pattern_weights != nullptr ? pattern_weights_checksum : EVAL_VERSION;
+}
+
+int32_t evaluate_board(board_t *board, bitboard_t player0_moves,
+                       bitboard_t player1_moves) {
+  if (nnue_net != nullptr) {
+    auto is_terminal =
+        evaluate_is_terminal(board, player0_moves, player1_moves);
+    if (is_terminal != 0)
+      return is_terminal;
+    nnue_accumulator_t acc;
+    nnue_refresh(nnue_net, board, &acc);
+    return nnue_evaluate(nnue_net, &acc);
+  }
+  if (pattern_weights != nullptr) {
+    return pattern_evaluate_selected(pattern_weights, board, player0_moves,
+                                     player1_moves);
+  }
+  return evaluate_board_selected(board, player0_moves, player1_moves);
+}
+
+int32_t evaluate_leaf(board_t *board) {
+  if (nnue_net == nullptr && pattern_weights == nullptr) {
+    board_features_t features;
+    board_gen_features(board, &features);
+    // a draw isn't told apart from a board still in play (as with
+    // evaluate_is_terminal)
+    if (features.mobility[0] == 0 && features.mobility[1] == 0 &&
+        evaluate_material(board) != 0)
+      return evaluate_material(board) * EVAL_INF;
+    return evaluate_features(&features);
+  }
+  auto player0_moves = board_gen_moves(board, 0);
+  auto player1_moves = board_gen_moves(board, 1);
+  auto is_terminal = evaluate_is_terminal(board, player0_moves, player1_moves);
+  if (is_terminal != 0)
+    return is_terminal;
+  return evaluate_board(board, player0_moves, player1_moves);
+}
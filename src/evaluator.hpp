@@ -1,10 +1,14 @@
 #pragma once
 
 #include "bitboard.hpp"
+#include "nnue.hpp"
 #include <cstdint>
 
 #define EVAL_INF    1000000
 #define MINIMAX_INF 1000000000
+// bump whenever evaluate_board's scores change (transposition table snapshots
+// of other versions are rejected)
+#define EVAL_VERSION 1
 
 /**
  * Evaluate a board.
@@ -13,6 +17,50 @@
 int32_t evaluate_board(board_t *board, bitboard_t player0_moves,
                        bitboard_t player1_moves);
 
+/**
+ * Evaluate a leaf of a search: evaluate_is_terminal's score if it isn't 0,
+ * evaluate_board's otherwise
+ * Generates the moves itself; with the built in evaluation, everything comes
+ * from one board_gen_features pass over the board */
+int32_t evaluate_leaf(board_t *board);
+
+/**
+ * Use the evaluate_board kernel of variant (see cpu_select) */
+void evaluator_select_kernels(cpu_variant_t variant);
+
+/**
+ * Evaluate boards with pattern weights (see pattern.hpp) from now on, or with
+ * the built in evaluation again if weights is nullptr
+ * The weights must stay valid while they are in use. It must not be called
+ * while other threads are evaluating boards. */
+void evaluator_use_patterns(const int16_t *weights);
+
+/* load pattern weights from a weight file and use them
+ * returns false (and leaves the evaluation as it was) if the file can't be
+ * loaded */
+bool evaluator_load_patterns(const char *path);
+
+/**
+ * Evaluate boards with a network (see nnue.hpp) from now on, or with the built
+ * in evaluation again if net is nullptr
+ * Replaces any pattern weights in use (as evaluator_use_patterns replaces any
+ * network). Same conditions as evaluator_use_patterns. */
+void evaluator_use_nnue(const nnue_t *net);
+
+/* load a network from a network file and use it
+ * returns false (and leaves the evaluation as it was) if the file can't be
+ * loaded */
+bool evaluator_load_nnue(const char *path);
+
+/* the network in use, nullptr if there is none
+ * evaluate_board runs the whole network on every board; searches instead keep
+ * an accumulator up to date as they make and undo moves, and evaluate that */
+const nnue_t *evaluator_nnue();
+
+/* identifies the scores evaluate_board gives: EVAL_VERSION for the built in
+ * evaluation, or a checksum of the pattern weights or network in use */
+uint32_t evaluator_version();
+
 /**
  * If the board is a terminal (end) board, return its score, 0 otherwise
  */
@@ -1,114 +1,372 @@
 #include "hash_table.hpp"
-#include "stats.hpp"
+#include "evaluator.hpp"
+#include <algorithm>
 #include <cassert>
-#include <cstdlib>
+#include <climits>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-/**
- * The hash table uses zobrist hashing
- * Each position and color combination has a random bitstring
- * The xor of all of the bitstrings produces the hash for the board
- */
-
-// TODO: precalculate these at compile time
-
-// random bitstrings for each piece
-// indexed as [location][color]
-static uint32_t piece_bitstrings[64][2];
-
-// hash results are precalculated for each row
-// indexed as [y][row combination][color]
-static uint32_t row_hash_precalc[8][256][2];
+/* the next output of a splitmix64 generator */
+static constexpr uint64_t hash_keys_next(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
 
-void hash_table_precalc() {
-  // precalc bitstrings
+static constexpr hash_keys_t hash_keys_gen() {
+  hash_keys_t keys{};
+  uint64_t state = 0;
   for (int i = 0; i < 64; i++) {
     for (int p = 0; p < 2; p++) {
-      piece_bitstrings[i][p] = rand();
+      keys.pieces[i][p] = hash_keys_next(&state);
     }
+    keys.flips[i] = keys.pieces[i][0] ^ keys.pieces[i][1];
   }
+  keys.side = hash_keys_next(&state);
 
   // precalculate rows
   for (int y = 0; y < 8; y++) {
     for (unsigned int row = 0; row < 256; row++) {
       for (int p = 0; p < 2; p++) {
-        uint32_t hash = 0;
-        unsigned int row_tmp = row;
-        while (row_tmp) {
-          int set_index = bits_index_of_first_set(row_tmp);
-          hash ^= piece_bitstrings[y * 8 + set_index][p];
-
-          row_tmp &= ~(1ULL << set_index);
+        uint64_t hash = 0;
+        for (int x = 0; x < 8; x++) {
+          if (row & (1U << x))
+            hash ^= keys.pieces[y * 8 + x][p];
         }
-
-        row_hash_precalc[y][row][p] = hash;
+        keys.rows[y][row][p] = hash;
       }
     }
   }
+  return keys;
+}
+
+extern constexpr hash_keys_t hash_keys = hash_keys_gen();
+
+/* pack the non-board fields of an entry into one word */
+static inline uint64_t hash_entry_pack(hash_entry_t *entry) {
+  return (uint64_t)(uint32_t)entry->value | ((uint64_t)entry->depth << 32) |
+         ((uint64_t)entry->best_move << 40) | ((uint64_t)entry->flags << 48) |
+         ((uint64_t)entry->epoch << 52) | ((uint64_t)entry->generation << 56);
+}
+
+static inline void hash_entry_unpack(uint64_t data, hash_entry_t *entry) {
+  entry->value = (int32_t)(uint32_t)data;
+  entry->depth = (data >> 32) & 0xff;
+  entry->best_move = (data >> 40) & 0xff;
+  entry->flags = (data >> 48) & 0xf;
+  entry->epoch = (data >> 52) & 0xf;
+  entry->generation = (data >> 56) & 0xff;
+}
+
+static inline void hash_slot_store(hash_slot_t *slot, uint64_t hash,
+                                   uint64_t data) {
+  slot->check.store(hash ^ data, std::memory_order_relaxed);
+  slot->data.store(data, std::memory_order_relaxed);
+}
+
+/* the bucket a (salted) hash belongs in
+ * The upper half of the hash is scaled to the number of buckets */
+static inline hash_bucket_t *hash_table_bucket(hash_table_t hash_table,
+                                               uint64_t hash) {
+  return &hash_table.buckets[((hash >> 32) * hash_table.num_buckets) >> 32];
 }
 
-void hash_table_alloc(hash_table_t *hash_table) {
-  hash_table->hash_table = static_cast<hash_entry_t *>(
-      calloc(HASH_TABLE_SIZE, sizeof(hash_entry_t)));
-  memset(hash_table->hash_table, 0, HASH_TABLE_SIZE * sizeof(hash_entry_t));
+/* how many generations ago an entry was stamped */
+static inline int hash_table_age_of(hash_table_t hash_table,
+                                    hash_entry_t *entry) {
+  return (uint8_t)(hash_table.generation - entry->generation);
+}
 
-  assert(hash_table->hash_table != nullptr);
+/* whether an entry is from before the last clear (it can't be found anymore,
+ * and its slot is as good as unused) */
+static inline bool hash_table_is_stale(hash_table_t hash_table,
+                                       hash_entry_t *entry) {
+  return entry->epoch != hash_table.epoch;
 }
 
-void hash_table_clear(hash_table_t hash_table) {
-#ifdef COUNT_STATS
-  table_set_entries = 0;
+bool hash_table_alloc(hash_table_t *hash_table, size_t megabytes) {
+  assert(megabytes > 0 && (megabytes & (megabytes - 1)) == 0);
+  size_t bytes = megabytes << 20;
+  hash_table->num_buckets = bytes / sizeof(hash_bucket_t);
+  hash_table->generation = 0;
+  hash_table->epoch = 0;
+  hash_table->salt = 0;
+  // anonymous mappings are page aligned, and read as zero (unused) until
+  // they are written
+  void *memory = MAP_FAILED;
+  hash_table->pages = HASH_PAGES_NORMAL;
+#ifdef MAP_HUGETLB
+  memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (memory != MAP_FAILED)
+    hash_table->pages = HASH_PAGES_HUGE;
 #endif
-  for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-    hash_table.hash_table[i].flags &= ~(HASH_TABLE_FLAGS_USED);
+  // without reserved huge pages, fall back to normal pages, and ask for them
+  // to be merged into transparent huge pages
+  if (memory == MAP_FAILED) {
+    memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      hash_table->buckets = nullptr;
+      return false;
+    }
+#ifdef MADV_HUGEPAGE
+    if (madvise(memory, bytes, MADV_HUGEPAGE) == 0)
+      hash_table->pages = HASH_PAGES_TRANSPARENT;
+#endif
+  }
+
+  hash_table->buckets = static_cast<hash_bucket_t *>(memory);
+  return true;
+}
+
+void hash_table_free(hash_table_t *hash_table) {
+  munmap(hash_table->buckets, hash_table->num_buckets * sizeof(hash_bucket_t));
+  hash_table->buckets = nullptr;
+}
+
+void hash_table_clear(hash_table_t *hash_table) {
+  hash_table->salt = hash_keys_next(&hash_table->salt);
+  hash_table->epoch = (hash_table->epoch + 1) % HASH_EPOCHS;
+  if (hash_table->epoch == 0) {
+    // the entries from HASH_EPOCHS clears ago would look current again, so
+    // wipe the table (dropping the pages of an anonymous mapping makes them
+    // read as zero again, without writing them)
+    size_t bytes = hash_table->num_buckets * sizeof(hash_bucket_t);
+    if (madvise(hash_table->buckets, bytes, MADV_DONTNEED) != 0)
+      memset(static_cast<void *>(hash_table->buckets), 0, bytes);
   }
 }
 
-void hash_table_age(hash_table_t hash_table) {
-  for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-    if(hash_table.hash_table[i].flags & HASH_TABLE_FLAGS_USED)
-      hash_table.hash_table[i].age++;
+void hash_table_age(hash_table_t *hash_table) { hash_table->generation++; }
+
+double hash_table_load_factor(hash_table_t hash_table) {
+  int used = 0;
+  int sample = (int)std::min<uint64_t>(
+      HASH_LOAD_SAMPLE, hash_table.num_buckets * HASH_BUCKET_SLOTS);
+  for (int i = 0; i < sample; i++) {
+    hash_slot_t *slot =
+        &hash_table.buckets[i / HASH_BUCKET_SLOTS].slots[i % HASH_BUCKET_SLOTS];
+    uint64_t data = slot->data.load(std::memory_order_relaxed);
+    hash_entry_t entry;
+    hash_entry_unpack(data, &entry);
+    if ((entry.flags & HASH_TABLE_FLAGS_USED) &&
+        !hash_table_is_stale(hash_table, &entry))
+      used++;
   }
+
+  return ((double)used) / ((double)sample);
 }
 
-uint32_t hash_board(board_t *board) {
-  uint32_t hash = 0;
+uint64_t hash_board(board_t *board, color_t player) {
+  uint64_t hash = player == 1 ? hash_keys.side : 0;
   for (int y = 0; y < 8; y++) {
     for (int p = 0; p < 2; p++) {
-      hash ^= row_hash_precalc[y][(board->players[p] >> (y * 8)) & 0xff][p];
+      hash ^= hash_keys.rows[y][(board->players[p] >> (y * 8)) & 0xff][p];
     }
   }
 
   return hash;
 }
 
-hash_entry_t *hash_table_lookup(hash_table_t hash_table, board_t *board) {
-  uint32_t hash = hash_board(board) & HASH_KEY_MASK;
-  hash_entry_t *entry = &hash_table.hash_table[hash];
+/* start of a snapshot file, followed by num_entries entries */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t eval_version;
+  // fingerprint of the hash keys the entries were hashed with
+  uint64_t keys;
+  uint64_t num_entries;
+} hash_snapshot_header_t;
+
+/* an entry of a snapshot (the epoch and generation in data are ignored) */
+typedef struct {
+  uint64_t hash;
+  uint64_t data;
+} hash_snapshot_entry_t;
+
+static const char hash_snapshot_magic[8] = {'O', 'T', 'H', 'E',
+                                            'L', 'L', 'O', 'T'};
 
-  if ((entry->flags & HASH_TABLE_FLAGS_USED) &&
-      board->players[0] == entry->board.players[0] &&
-      board->players[1] == entry->board.players[1]) {
-    entry->age = 0;
-    return entry;
-  } else {
-    return nullptr;
+/* the header snapshots of this build have */
+static hash_snapshot_header_t hash_snapshot_header(uint64_t num_entries) {
+  hash_snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, hash_snapshot_magic, sizeof(header.magic));
+  header.version = HASH_SNAPSHOT_VERSION;
+  header.eval_version = evaluator_version();
+  uint64_t keys = 0;
+  for (int i = 0; i < 64; i++) {
+    for (int p = 0; p < 2; p++)
+      keys = hash_keys_next(&keys) ^ hash_keys.pieces[i][p];
   }
+  header.keys = hash_keys_next(&keys) ^ hash_keys.side;
+  header.num_entries = num_entries;
+  return header;
+}
+
+int64_t hash_table_save(hash_table_t hash_table, const char *path,
+                        int min_depth) {
+  // written next to the snapshot and renamed over it once complete, so a
+  // crash halfway through doesn't leave a truncated snapshot behind
+  std::string tmp_path = std::string(path) + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr)
+    return -1;
+
+  // the entry count is only known at the end
+  hash_snapshot_header_t header = hash_snapshot_header(0);
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  uint64_t num_entries = 0;
+  for (uint64_t b = 0; b < hash_table.num_buckets && ok; b++) {
+    for (int i = 0; i < HASH_BUCKET_SLOTS; i++) {
+      hash_slot_t *slot = &hash_table.buckets[b].slots[i];
+      uint64_t data = slot->data.load(std::memory_order_relaxed);
+      hash_entry_t entry;
+      hash_entry_unpack(data, &entry);
+      // entries from before the last clear can't be found anymore (and their
+      // keys are salted with an older salt)
+      if (!(entry.flags & HASH_TABLE_FLAGS_USED) || entry.depth < min_depth ||
+          hash_table_is_stale(hash_table, &entry))
+        continue;
+
+      hash_snapshot_entry_t saved;
+      saved.hash =
+          slot->check.load(std::memory_order_relaxed) ^ data ^ hash_table.salt;
+      saved.data = data;
+      ok = fwrite(&saved, sizeof(saved), 1, file) == 1;
+      num_entries++;
+    }
+  }
+
+  header.num_entries = num_entries;
+  ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+       fwrite(&header, sizeof(header), 1, file) == 1;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path) != 0) {
+    unlink(tmp_path.c_str());
+    return -1;
+  }
+  return (int64_t)num_entries;
+}
+
+int64_t hash_table_load(hash_table_t hash_table, const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(hash_snapshot_header_t)) {
+    close(fd);
+    return -1;
+  }
+  size_t size = (size_t)st.st_size;
+  void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+    return -1;
+  // read once front to back
+  madvise(memory, size, MADV_SEQUENTIAL);
+
+  const hash_snapshot_header_t *header =
+      static_cast<const hash_snapshot_header_t *>(memory);
+  hash_snapshot_header_t expected = hash_snapshot_header(header->num_entries);
+  int64_t num_entries = -1;
+  if (memcmp(header, &expected, sizeof(expected)) == 0 &&
+      header->num_entries ==
+          (size - sizeof(*header)) / sizeof(hash_snapshot_entry_t)) {
+    const hash_snapshot_entry_t *entries =
+        reinterpret_cast<const hash_snapshot_entry_t *>(header + 1);
+    for (uint64_t i = 0; i < header->num_entries; i++) {
+      hash_entry_t entry;
+      hash_entry_unpack(entries[i].data, &entry);
+      entry.hash = entries[i].hash;
+      hash_table_insert(hash_table, &entry);
+    }
+    num_entries = (int64_t)header->num_entries;
+  }
+
+  munmap(memory, size);
+  return num_entries;
+}
+
+bool hash_table_lookup(hash_table_t hash_table, uint64_t hash,
+                       hash_entry_t *dst) {
+  uint64_t key = hash ^ hash_table.salt;
+  hash_bucket_t *bucket = hash_table_bucket(hash_table, key);
+
+  for (int i = 0; i < HASH_BUCKET_SLOTS; i++) {
+    hash_slot_t *slot = &bucket->slots[i];
+    uint64_t data = slot->data.load(std::memory_order_relaxed);
+    uint64_t check = slot->check.load(std::memory_order_relaxed);
+
+    // a torn or foreign slot won't xor back to our hash
+    if (!((data >> 48) & HASH_TABLE_FLAGS_USED) || (check ^ data) != key)
+      continue;
+
+    hash_entry_unpack(data, dst);
+    dst->hash = hash;
+    // restamp the entry, as it is still in use
+    if (dst->generation != hash_table.generation) {
+      dst->generation = hash_table.generation;
+      hash_slot_store(slot, key, hash_entry_pack(dst));
+    }
+    return true;
+  }
+
+  return false;
+}
+
+void hash_table_prefetch(hash_table_t hash_table, uint64_t hash) {
+  __builtin_prefetch(hash_table_bucket(hash_table, hash ^ hash_table.salt));
 }
 
 void hash_table_insert(hash_table_t hash_table, hash_entry_t *entry) {
-  // hash entry
-  uint32_t hash = hash_board(&entry->board) & HASH_KEY_MASK;
-  // existing entry
-  hash_entry_t *slot = &hash_table.hash_table[hash];
-
-  /* if slot is unused, replace
-   * if the new entry has a higher depth, replace */
-  if (!(slot->flags & HASH_TABLE_FLAGS_USED) || entry->depth > slot->depth  || entry->age >= 2) {
-#ifdef COUNT_STATS
-    if (!(slot->flags & HASH_TABLE_FLAGS_USED))
-      table_set_entries++;
-#endif
-    memcpy(slot, entry, sizeof(hash_entry_t));
+  uint64_t key = entry->hash ^ hash_table.salt;
+  hash_bucket_t *bucket = hash_table_bucket(hash_table, key);
+  hash_entry_t stamped = *entry;
+  stamped.epoch = hash_table.epoch;
+  stamped.generation = hash_table.generation;
+  uint64_t new_data = hash_entry_pack(&stamped);
+
+  /* an entry for the same board is replaced if the new one is at least as deep
+   * (or the old one is from an earlier generation), otherwise the slot worth
+   * the least is: an unused one (or one from before the last clear), or else
+   * the shallowest, counting older entries as shallower */
+  hash_slot_t *replace = nullptr;
+  int replace_worth = 0;
+  for (int i = 0; i < HASH_BUCKET_SLOTS; i++) {
+    hash_slot_t *slot = &bucket->slots[i];
+    uint64_t data = slot->data.load(std::memory_order_relaxed);
+    hash_entry_t existing;
+    hash_entry_unpack(data, &existing);
+
+    if (!(existing.flags & HASH_TABLE_FLAGS_USED) ||
+        hash_table_is_stale(hash_table, &existing)) {
+      if (replace == nullptr || replace_worth > INT_MIN) {
+        replace = slot;
+        replace_worth = INT_MIN;
+      }
+      continue;
+    }
+    int age = hash_table_age_of(hash_table, &existing);
+    if ((slot->check.load(std::memory_order_relaxed) ^ data) == key) {
+      if (entry->depth >= existing.depth || age != 0)
+        hash_slot_store(slot, key, new_data);
+      return;
+    }
+    int worth = existing.depth - HASH_AGE_WEIGHT * age;
+    if (replace == nullptr || worth < replace_worth) {
+      replace = slot;
+      replace_worth = worth;
+    }
   }
-}
\ No newline at end of file
+
+  hash_slot_store(replace, key, new_data);
+}
@@ -1,58 +1,201 @@
 #pragma once
 #include "bitboard.hpp"
+#include <atomic>
+#include <cstddef>
 
 /**
  * Transposition Table
  * The table maps hashes of already visited board positions to their values
- * calculated on the previous visit. The hash table is open addressed and has a
- * fixed size. Entries are replaced as it fills up.
+ * calculated on the previous visit. The table is split into buckets of
+ * HASH_BUCKET_SLOTS slots, one cache line each, and a board can be stored in
+ * any slot of the bucket its hash picks, so a lookup costs one cache miss.
+ * Only a 64 bit hash of the board is kept, not the board itself. When a bucket
+ * is full, the shallowest / oldest of its entries is replaced.
+ *
+ * Entries are stamped with the table's generation when they are written (or
+ * found), and aging the table only advances the generation, so an entry's age
+ * is how many generations it is behind. Clearing the table also changes the
+ * salt xor'ed into every hash, so the old entries can't be found anymore.
+ * Neither touches the entries themselves. Ages are counted modulo
+ * HASH_GENERATIONS, so an entry left alone that long counts as new again until
+ * it is replaced.
+ *
+ * A clear also starts a new epoch, which entries are stamped with as well, so
+ * the entries from before a clear are told apart from the current ones however
+ * many generations have passed since (they are replaced like unused slots, and
+ * left out of snapshots). The epoch stamp is only 4 bits, so every HASH_EPOCHS
+ * clears the table is wiped for real before the epochs repeat.
+ *
+ * The table is shared between search threads without locks. Each slot stores
+ * the hash xor'ed with the packed entry data, so a slot torn by two threads
+ * writing at once fails verification on lookup instead of being trusted.
  */
 
-/* Hash table key size mask */
-#define HASH_KEY_MASK 0xffffff
-// hash table size (2^HASH_KEY_SIZE)
-#define HASH_TABLE_SIZE 16777216
+// slots per bucket (a bucket fills a 64 byte cache line)
+#define HASH_BUCKET_SLOTS 4
+// table size (in MB) used unless another is asked for
+#define HASH_TABLE_DEFAULT_MB 256
+// number of slots sampled to estimate the load factor
+#define HASH_LOAD_SAMPLE 65536
+// how many depth levels one search of age makes an entry worth less when
+// picking the entry to replace
+#define HASH_AGE_WEIGHT 16
+// entries at least this deep are saved in snapshots
+#define HASH_SNAPSHOT_MIN_DEPTH 6
+// bump when the snapshot format changes
+#define HASH_SNAPSHOT_VERSION 1
+// number of distinct generations (the stamp is 8 bits)
+#define HASH_GENERATIONS 256
+// number of distinct clear epochs (the stamp is 4 bits)
+#define HASH_EPOCHS 16
 
 #define HASH_TABLE_FLAGS_USED 1
 #define BOUND_TYPE_EXACT 2
 #define BOUND_TYPE_LOWERBOUND 4
 #define BOUND_TYPE_UPERBOUND 8
 
-/* TODO: aging replacement of nodes */
 typedef struct {
-  /* exact bound value */
-  board_t board;
+  /* hash of the board (and side to move) the entry is for */
+  uint64_t hash;
   /* minimax value (considering bound_type) */
   int32_t value;
   /* depth of search performed from this node */
   uint8_t depth;
   /* best move from this position */
   uint8_t best_move;
-  /* bound characteristic of the move */
+  /* bound characteristic of the move (4 bits) */
   uint8_t flags;
-  /* age of the entry */
-  uint8_t age;
+  /* epoch of the table when the entry was written (set by the table) */
+  uint8_t epoch;
+  /* generation of the table when the entry was last written or found (set by
+   * the table) */
+  uint8_t generation;
 } hash_entry_t;
 
+/* an entry as stored in the table
+ * data is the packed value/depth/best_move/flags/epoch/generation of the
+ * entry, and check holds the entry's (salted) hash ^ data */
 typedef struct {
-  hash_entry_t *hash_table;
+  std::atomic<uint64_t> check;
+  std::atomic<uint64_t> data;
+} hash_slot_t;
+
+typedef struct alignas(64) {
+  hash_slot_t slots[HASH_BUCKET_SLOTS];
+} hash_bucket_t;
+
+/* the kind of pages backing a table (huge pages save most of the tlb misses
+ * of random lookups) */
+typedef enum {
+  HASH_PAGES_NORMAL,
+  // transparent huge pages were asked for (the kernel may not grant them)
+  HASH_PAGES_TRANSPARENT,
+  // reserved (hugetlbfs) huge pages
+  HASH_PAGES_HUGE,
+} hash_pages_t;
+
+typedef struct {
+  hash_bucket_t *buckets;
+  uint64_t num_buckets;
+  hash_pages_t pages;
+  // generation entries are stamped with
+  uint8_t generation;
+  // epoch entries are stamped with (clears so far, modulo HASH_EPOCHS)
+  uint8_t epoch;
+  // xor'ed into hashes, changed by each clear
+  uint64_t salt;
 } hash_table_t;
 
-uint32_t hash_board(board_t *board);
+/**
+ * Zobrist hashing
+ * Each square and color has a random 64 bit key. The hash of a board is the xor
+ * of the keys of its pieces, and of the side key if player 1 is to move. A move
+ * changes the hash by the keys of the squares it changes, so the search
+ * updates the hash along with the board instead of hashing each board it
+ * visits. The keys are generated at compile time. */
+typedef struct {
+  // indexed as [location][color]
+  uint64_t pieces[64][2];
+  // both colors' keys of a square (flipping a piece changes the hash by this)
+  uint64_t flips[64];
+  // xor of the keys of each row combination
+  // indexed as [y][row combination][color]
+  uint64_t rows[8][256][2];
+  // player 1 to move
+  uint64_t side;
+} hash_keys_t;
+
+extern const hash_keys_t hash_keys;
+
+/* hash of board with player to move */
+uint64_t hash_board(board_t *board, color_t player);
 
-/* allocate a hash table */
-void hash_table_alloc(hash_table_t *hash_table);
+/* hash of the board after player makes move (flipping flips) on the board
+ * hash is for, with the other player to move */
+static inline uint64_t hash_move(uint64_t hash, move_t move, bitboard_t flips,
+                                 color_t player) {
+  hash ^= hash_keys.pieces[move][player] ^ hash_keys.side;
+  while (flips) {
+    hash ^= hash_keys.flips[bits_index_of_first_set(flips)];
+    flips &= flips - 1;
+  }
+  return hash;
+}
+
+/* hash of the same board with the other player to move */
+static inline uint64_t hash_pass(uint64_t hash) {
+  return hash ^ hash_keys.side;
+}
+
+/* allocate an empty hash table of megabytes MB (a power of two)
+ * The memory comes zeroed from the os, and isn't touched until it is used.
+ * returns false if it couldn't be allocated */
+bool hash_table_alloc(hash_table_t *hash_table, size_t megabytes);
+
+/* release the memory of a hash table */
+void hash_table_free(hash_table_t *hash_table);
+
+/* clear a hash table (no entry from before can be found afterwards)
+ * Copies of the table taken before don't see the change, so it must not be
+ * cleared while it is being searched */
+void hash_table_clear(hash_table_t *hash_table);
+
+/* age all entries in the hash table by one generation (the same goes as for
+ * hash_table_clear) */
+void hash_table_age(hash_table_t *hash_table);
+
+/* estimate the fraction of used slots in the table (not counting entries from
+ * before the last clear) */
+double hash_table_load_factor(hash_table_t hash_table);
+
+/**
+ * Snapshots
+ * The entries of a table at least min_depth deep can be saved to a file, and
+ * loaded into a table of any size in a later run, so that the analysis of
+ * earlier games isn't lost when the program restarts. The file starts with a
+ * header holding the snapshot version, a fingerprint of the hash keys, and
+ * evaluator_version(), and a snapshot with a different header is rejected (its
+ * hashes or values would mean something else). */
 
-/* clear a hash table (set all entries to unused) */
-void hash_table_clear(hash_table_t hash_table);
+/* save the entries at least min_depth deep (the table must not be searched
+ * meanwhile)
+ * returns the number of entries saved, or -1 if the file couldn't be written */
+int64_t hash_table_save(hash_table_t hash_table, const char *path,
+                        int min_depth);
 
-/* age all entries in the hash table */
-void hash_table_age(hash_table_t hash_table);
+/* insert the entries of a snapshot into the table (as if they were found in the
+ * current generation)
+ * returns the number of entries loaded, or -1 if the file couldn't be read or
+ * is from another version */
+int64_t hash_table_load(hash_table_t hash_table, const char *path);
 
-/* hash table precalculations */
-void hash_table_precalc();
+/* lookup the entry for a board hash in hash table
+ * copies the entry into dst and returns true if it was found */
+bool hash_table_lookup(hash_table_t hash_table, uint64_t hash,
+                       hash_entry_t *dst);
+/* start loading the bucket of a board hash into the cache, so that a lookup
+ * soon after doesn't have to wait for memory */
+void hash_table_prefetch(hash_table_t hash_table, uint64_t hash);
 
-/* lookup entry in hash table */
-hash_entry_t *hash_table_lookup(hash_table_t hash_table, board_t *board);
 /* add entry to hash table */
-void hash_table_insert(hash_table_t hash_table, hash_entry_t *entry);
\ No newline at end of file
+void hash_table_insert(hash_table_t hash_table, hash_entry_t *entry);
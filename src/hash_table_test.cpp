@@ -0,0 +1,146 @@
+#include "hash_table.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+/**
+ * Transposition table tests
+ * Checks that entries from before a clear don't hold on to their slots, and
+ * aren't saved in snapshots, however the table was cleared and aged since.
+ * Returns nonzero if a check fails. */
+
+#define HASH_TEST_MB 1
+// written (and removed again) in the working directory
+#define HASH_TEST_SNAPSHOT "hash_table_test.tt"
+
+static int hash_test_failures = 0;
+
+#define hash_test_check(cond, ...)                                             \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("FAIL %s:%i: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+      hash_test_failures++;                                                    \
+    }                                                                          \
+  } while (0)
+
+/* a hash that lands in bucket of the table (the bucket is picked by the upper
+ * half of the salted hash), distinct for each i */
+static uint64_t hash_test_key(hash_table_t hash_table, uint64_t bucket,
+                              uint64_t i) {
+  uint64_t upper = bucket * ((1ULL << 32) / hash_table.num_buckets);
+  return ((upper << 32) | (i + 1)) ^ hash_table.salt;
+}
+
+/* fill bucket with entries of depth, keyed by i = first.. */
+static void hash_test_fill(hash_table_t hash_table, uint64_t bucket, int first,
+                           int depth) {
+  for (int i = first; i < first + HASH_BUCKET_SLOTS; i++) {
+    hash_entry_t entry;
+    entry.hash = hash_test_key(hash_table, bucket, i);
+    entry.value = i;
+    entry.depth = depth;
+    entry.best_move = 0;
+    entry.flags = HASH_TABLE_FLAGS_USED | BOUND_TYPE_EXACT;
+    hash_table_insert(hash_table, &entry);
+  }
+}
+
+/* the deepest entries go in before clears, the shallowest after, and all of
+ * the new ones have to be found */
+static void hash_test_replaced(const char *name, int clears, int ages) {
+  hash_table_t hash_table;
+  if (!hash_table_alloc(&hash_table, HASH_TEST_MB)) {
+    printf("Couldn't allocate the table\n");
+    exit(1);
+  }
+  hash_test_fill(hash_table, 0, 0, 60);
+  for (int i = 0; i < clears; i++)
+    hash_table_clear(&hash_table);
+  for (int i = 0; i < ages; i++)
+    hash_table_age(&hash_table);
+  hash_test_fill(hash_table, 0, HASH_BUCKET_SLOTS, 1);
+
+  for (int i = HASH_BUCKET_SLOTS; i < 2 * HASH_BUCKET_SLOTS; i++) {
+    hash_entry_t entry;
+    uint64_t hash = hash_test_key(hash_table, 0, i);
+    bool found = hash_table_lookup(hash_table, hash, &entry);
+    hash_test_check(found && entry.value == i,
+                    "%s: entry %i was pushed out by an entry from before the "
+                    "clear",
+                    name, i);
+  }
+  hash_test_check(hash_table_load_factor(hash_table) > 0.0 &&
+                      hash_table_load_factor(hash_table) <
+                          2.0 * HASH_BUCKET_SLOTS / HASH_LOAD_SAMPLE,
+                  "%s: entries from before the clear are counted as used",
+                  name);
+  hash_table_free(&hash_table);
+}
+
+/* deep entries go in before each of clears, in a bucket of their own, and only
+ * the ones from after the last clear may be saved and loaded again */
+static void hash_test_snapshot(const char *name, int clears, int ages) {
+  hash_table_t hash_table;
+  hash_table_t loaded;
+  if (!hash_table_alloc(&hash_table, HASH_TEST_MB) ||
+      !hash_table_alloc(&loaded, HASH_TEST_MB)) {
+    printf("Couldn't allocate the tables\n");
+    exit(1);
+  }
+  for (int i = 0; i < clears; i++) {
+    hash_test_fill(hash_table, i, 0, 60);
+    hash_table_clear(&hash_table);
+  }
+  for (int i = 0; i < ages; i++)
+    hash_table_age(&hash_table);
+  hash_test_fill(hash_table, clears, 0, 60);
+
+  int64_t saved = hash_table_save(hash_table, HASH_TEST_SNAPSHOT, 0);
+  hash_test_check(saved == HASH_BUCKET_SLOTS,
+                  "%s: %lli entries saved instead of %i", name,
+                  (long long)saved, HASH_BUCKET_SLOTS);
+  hash_table_clear(&loaded);
+  int64_t num_loaded = hash_table_load(loaded, HASH_TEST_SNAPSHOT);
+  hash_test_check(num_loaded == saved, "%s: %lli entries loaded of %lli", name,
+                  (long long)num_loaded, (long long)saved);
+  unlink(HASH_TEST_SNAPSHOT);
+
+  // the snapshot keeps the board hashes (the loaded table has a salt of its
+  // own)
+  for (int i = 0; i < HASH_BUCKET_SLOTS; i++) {
+    uint64_t hash = hash_test_key(hash_table, clears, i);
+    hash_entry_t entry;
+    hash_test_check(hash_table_lookup(loaded, hash, &entry) &&
+                        entry.value == i && entry.depth == 60,
+                    "%s: entry %i wasn't loaded", name, i);
+  }
+  hash_test_check(hash_table_load_factor(loaded) <
+                      1.5 * HASH_BUCKET_SLOTS / HASH_LOAD_SAMPLE,
+                  "%s: entries with foreign keys were loaded", name);
+  hash_table_free(&hash_table);
+  hash_table_free(&loaded);
+}
+
+int main() {
+  hash_test_replaced("one clear", 1, 0);
+  hash_test_replaced("two clears", 2, 0);
+  hash_test_replaced("a clear, then half the generations", 1,
+                     HASH_GENERATIONS / 2);
+  hash_test_replaced("a clear for every epoch", HASH_EPOCHS, 0);
+  hash_test_replaced("more clears than epochs", HASH_EPOCHS + 3, 5);
+  hash_test_snapshot("snapshot after one clear", 1, 0);
+  hash_test_snapshot("snapshot after two clears", 2, 0);
+  hash_test_snapshot("snapshot after a clear and half the generations", 1,
+                     HASH_GENERATIONS / 2);
+  hash_test_snapshot("snapshot after more clears than epochs",
+                     HASH_EPOCHS + 3, 0);
+
+  if (hash_test_failures > 0) {
+    printf("%i checks failed\n", hash_test_failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
@@ -1,135 +1,283 @@
 #include "minimax.hpp"
+#include "endgame.hpp"
+#include "search.hpp"
 #include "stats.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <cmath>
 #include <thread>
+#include <vector>
 
-// in order to facilitate limited search timing, minimax checks the time every
-// ~half a million boards
-static int board_i;
-#define TIME_CHECK_BOARDS 2000000
+// half width of the first aspiration window
+#define ASPIRATION_WINDOW 16
+// factor the window grows by on each fail low / high
+#define ASPIRATION_WIDEN 4
+// windows wider than this are replaced by the full window
+#define ASPIRATION_MAX_WINDOW 4096
 
-class OthelloTimeUp {};
+// iterations with the same best move after which the move is considered settled
+#define TIME_STABLE_ITERATIONS 3
 
-static inline int32_t minimax(move_t *dst_best_move, board_t *old_board,
-                              move_t move_to_make, int depth, int32_t alpha,
-                              int32_t beta, color_t player,
-                              hash_table_t hash_table, time_t *start_time,
-                              double search_time) {
-  board_i++;
-  if (board_i > TIME_CHECK_BOARDS) {
-    board_i = 0;
-    time_t curTime = time(nullptr);
-    auto diff = difftime(curTime, *start_time);
-    printf("Searching... %.0lf s    \r", search_time - diff);
-    fflush(stdout);
-    if (diff >= search_time) {
-      throw OthelloTimeUp();
-    }
+// shallowest depth at which children are looked up before searching them
+#define ETC_MIN_DEPTH 3
+
+/* search board (with player to move, hashing to hash) to depth
+ * moves are made and undone on board in place, so it is unchanged on return */
+static inline int32_t minimax(search_thread_t *thread, move_t *dst_best_move,
+                              board_t *board, uint64_t hash, int depth,
+                              int32_t alpha, int32_t beta, color_t player) {
+  if (search_thread_poll(thread)) {
+    return 0;
   }
 #ifdef COUNT_STATS
-  boards_visited++;
+  thread->stats.boards_visited++;
 #endif
   // preserve original alpha value
   int32_t orig_alpha = alpha;
 
-  // copy board and make move
-  board_t board = *old_board;
-  if (move_to_make != 255) {
-    board_make_move(&board, move_to_make, player == 1 ? 0 : 1);
-  }
-
   auto color = player == 1 ? -1 : 1;
+  // if max depth was hit, stop (evaluate_leaf generates the moves it needs,
+  // and checks for the end of the game itself)
+  if (depth == 0 && thread->nnue == nullptr) {
+    return color * evaluate_leaf(board);
+  }
   // calculate moves for each player
-  auto player0_moves = board_gen_moves(&board, 0);
-  auto player1_moves = board_gen_moves(&board, 1);
+  auto player0_moves = board_gen_moves(board, 0);
+  auto player1_moves = board_gen_moves(board, 1);
   // if node is a win/loss, stop
-  auto is_terminal = evaluate_is_terminal(&board, player0_moves, player1_moves);
+  auto is_terminal = evaluate_is_terminal(board, player0_moves, player1_moves);
   if (is_terminal != 0) {
     return color * is_terminal;
   }
   // if max depth was hit, stop
   if (depth == 0) {
-    return color * evaluate_board(&board, player0_moves, player1_moves);
+    return color * nnue_evaluate(thread->nnue, &thread->accumulator);
+  }
+
+  // once the search would reach the end of the game anyway, solve it exactly
+  auto empties = 64 - bits_popcount(board->players[0] | board->players[1]);
+  if (empties <= thread->config->endgame_empties && depth >= empties) {
+    return endgame_solve(thread, dst_best_move, board, hash, player, alpha,
+                         beta);
+  }
+
+  // pick moves for us
+  auto moves = player == 1 ? player1_moves : player0_moves;
+  // if there are no legal moves for this player, skip to next player
+  // (without using the table, as the board is the same as the child's)
+  if (!moves) {
+    // we shouldn't have been asked for a move if we don't have any
+    assert(dst_best_move == nullptr);
+    return -minimax(thread, nullptr, board, hash_pass(hash), depth - 1, -beta,
+                    -alpha, player == 1 ? 0 : 1);
   }
 
-  // first move to try
-  move_t first_move = 255;
-  move_t first_move_ignore_normal = 255;
+  // best move from the table, searched first
+  move_t tt_move = 255;
   // lookup board in hash table
-  hash_entry_t *hash_entry = hash_table_lookup(hash_table, &board);
-  if (hash_entry != nullptr && hash_entry->depth >= depth) {
+  int symmetry;
+  uint64_t key = search_table_key(thread, board, hash, player, &symmetry);
+  hash_entry_t hash_entry;
+  // the table only keeps a hash of the board, so an entry whose best move isn't
+  // legal here is for some other board (entries without a move, 255, aren't
+  // used, and can't be shifted by)
+  bool hash_hit = search_table_lookup(thread, key, symmetry, &hash_entry) &&
+                  hash_entry.best_move < 64 &&
+                  (moves & (1ULL << hash_entry.best_move));
+#ifdef COUNT_STATS
+  thread->stats.table_probes++;
+  thread->stats.table_hits += hash_hit;
+#endif
+  if (hash_hit && hash_entry.depth >= depth) {
     // entry is valid
-    if (hash_entry->flags & BOUND_TYPE_EXACT) {
+    if (hash_entry.flags & BOUND_TYPE_EXACT) {
 #ifdef COUNT_STATS
-      boards_direct_table_hits++;
+      thread->stats.boards_direct_table_hits++;
 #endif
       if (dst_best_move != nullptr) {
-        *dst_best_move = hash_entry->best_move;
+        *dst_best_move = hash_entry.best_move;
       }
-      return hash_entry->value;
-    } else if (hash_entry->flags & BOUND_TYPE_LOWERBOUND) {
+      return hash_entry.value;
+    } else if (hash_entry.flags & BOUND_TYPE_LOWERBOUND) {
 #ifdef COUNT_STATS
-      boards_bounds_table_hits++;
+      thread->stats.boards_bounds_table_hits++;
 #endif
-      alpha = std::max(alpha, hash_entry->value);
-    } else if (hash_entry->flags & BOUND_TYPE_UPERBOUND) {
+      alpha = std::max(alpha, hash_entry.value);
+    } else if (hash_entry.flags & BOUND_TYPE_UPERBOUND) {
 #ifdef COUNT_STATS
-      boards_bounds_table_hits++;
+      thread->stats.boards_bounds_table_hits++;
 #endif
-      beta = std::min(beta, hash_entry->value);
+      beta = std::min(beta, hash_entry.value);
     }
 
     // check for cutoff
     if (alpha >= beta) {
       if (dst_best_move != nullptr) {
-        *dst_best_move = hash_entry->best_move;
+        *dst_best_move = hash_entry.best_move;
       }
-      return hash_entry->value;
+      return hash_entry.value;
     }
-  } else if (hash_entry != nullptr && hash_entry->depth < depth) {
+    tt_move = hash_entry.best_move;
+  } else if (hash_hit && hash_entry.depth < depth) {
 #ifdef COUNT_STATS
-    boards_best_move_hits++;
+    thread->stats.boards_best_move_hits++;
 #endif
     // search was to lower depth, but we can use it to order moves
-    first_move = hash_entry->best_move;
-    first_move_ignore_normal = first_move;
+    tt_move = hash_entry.best_move;
   }
 
   // can't use entry in hash table, so run minimax
 
-  int32_t value = -MINIMAX_INF;
-  // pick moves for us
-  auto moves = player == 1 ? player1_moves : player0_moves;
-  // if there are no legal moves for this player, skip to next player
-  if (!moves) {
-    value = -minimax(nullptr, &board, 255, depth - 1, -beta, -alpha,
-                     player == 1 ? 0 : 1, hash_table, start_time, search_time);
+  // the best score player can still reach is capped by the opponent's stable
+  // pieces (only checked once the opponent has enough pieces for that to reach
+  // alpha, and not at the root, which needs a move even if a table bound
+  // already raised alpha)
+  if (thread->config->stability && dst_best_move == nullptr &&
+      (64 - 2 * bits_popcount(board->players[!player])) * EVAL_INF <= alpha) {
+    int32_t bound =
+        (64 - 2 * bits_popcount(board_gen_stable(board, !player))) * EVAL_INF;
+    if (bound <= alpha) {
+#ifdef COUNT_STATS
+      thread->stats.stability_cutoffs++;
+#endif
+      return bound;
+    }
+  }
 
-    // we shouldn't have been asked for a move if we don't have any
-    assert(dst_best_move == nullptr);
-    return value;
+  // enhanced transposition cutoff: a child whose table entry already proves
+  // it is at least beta for us cuts the node before anything is searched
+  // (not at the root)
+  if (thread->config->etc && dst_best_move == nullptr &&
+      depth >= ETC_MIN_DEPTH) {
+    auto etc_moves = moves;
+    while (etc_moves) {
+      move_t move = bitboard_get_and_clear_first_move(&etc_moves);
+      auto flips = board_gen_flips(board, move, player);
+      board_do_move(board, move, flips, player);
+      int child_symmetry;
+      uint64_t child_key =
+          search_table_key(thread, board, hash_move(hash, move, flips, player),
+                           !player, &child_symmetry);
+      hash_entry_t child_entry;
+      bool refutes =
+          search_table_lookup(thread, child_key, child_symmetry,
+                              &child_entry) &&
+          child_entry.depth >= depth - 1 &&
+          (child_entry.flags & (BOUND_TYPE_EXACT | BOUND_TYPE_UPERBOUND)) &&
+          -child_entry.value >= beta &&
+          // only for children the opponent can move in (pass nodes don't use
+          // the table)
+          board_gen_moves(board, player == 1 ? 0 : 1);
+      board_undo_move(board, move, flips, player);
+      if (!refutes)
+        continue;
+#ifdef COUNT_STATS
+      thread->stats.etc_cutoffs++;
+#endif
+      return -child_entry.value;
+    }
+  }
+
+  // multi-probcut: cut the node if shallow searches predict that the full
+  // search would fail high or low (not at the root, and not with proven win /
+  // loss bounds, which the predictions know nothing about)
+  int phase = probcut_phase(empties);
+  int level = thread->config->probcut[phase];
+  if (level > 0 && dst_best_move == nullptr && depth >= PROBCUT_MIN_DEPTH &&
+      alpha > -EVAL_INF && beta < EVAL_INF) {
+    double threshold = probcut_threshold(level);
+    for (int check = 0; check < PROBCUT_CHECKS; check++) {
+      const probcut_param_t *param = probcut_params(phase, depth, check);
+      if (param == nullptr)
+        break;
+      int shallow = probcut_shallow_depth(depth, check);
+      double margin = threshold * param->sigma;
+
+      // shallow score above which the deep score is likely >= beta
+      int32_t bound = (int32_t)ceil((beta + margin - param->b) / param->a);
+#ifdef COUNT_STATS
+      thread->stats.probcut_probes++;
+#endif
+      int32_t score = minimax(thread, nullptr, board, hash, shallow, bound - 1,
+                              bound, player);
+      if (thread->aborted) {
+        return 0;
+      }
+      if (score >= bound) {
+#ifdef COUNT_STATS
+        thread->stats.probcut_cuts++;
+#endif
+        return beta;
+      }
+
+      // shallow score below which the deep score is likely <= alpha
+      bound = (int32_t)floor((alpha - margin - param->b) / param->a);
+#ifdef COUNT_STATS
+      thread->stats.probcut_probes++;
+#endif
+      score = minimax(thread, nullptr, board, hash, shallow, bound, bound + 1,
+                      player);
+      if (thread->aborted) {
+        return 0;
+      }
+      if (score <= bound) {
+#ifdef COUNT_STATS
+        thread->stats.probcut_cuts++;
+#endif
+        return alpha;
+      }
+    }
   }
+
+  // order moves (helpers with odd ids break ties from h8 down instead)
+  int ply = thread->root_depth - depth;
+  move_list_t list;
+  move_order_gen(&thread->order, &list, board, moves, player, depth, ply,
+                 tt_move, thread->id & 1);
+
+  int32_t value = -MINIMAX_INF;
   // visit each move
   move_t best_move = 255;
-  while (moves) {
-    move_t move;
-    // if we found a first move, use it first
-    if (first_move != 255) {
-      move = first_move;
-      // clear first move
-      first_move = 255;
+  for (int i = 0; i < list.count; i++) {
+    move_t move = list.moves[i];
+    bool first_child = i == 0;
+    auto flips = board_gen_flips(board, move, player);
+    board_do_move(board, move, flips, player);
+    if (thread->nnue != nullptr)
+      nnue_do_move(thread->nnue, &thread->accumulator, move, flips, player);
+    auto child_hash = hash_move(hash, move, flips, player);
+    // the child looks itself up once it has generated its moves, by which
+    // time its bucket can be in the cache (leaves don't use the table, and
+    // a symmetric key isn't known yet)
+    if (depth > 1 && !search_symmetric_key(thread, board))
+      hash_table_prefetch(thread->hash_table, child_hash);
+    // run minimax on move
+    int32_t child_score;
+    if (first_child || !thread->config->pvs) {
+      child_score = -minimax(thread, nullptr, board, child_hash, depth - 1,
+                             -beta, -alpha, player == 1 ? 0 : 1);
     } else {
-      move = bitboard_get_and_clear_first_move(&moves);
-      if (move == first_move_ignore_normal)
-        continue;
+      // prove the move is no better than alpha with a null window, and only
+      // search it fully if that fails
+      child_score = -minimax(thread, nullptr, board, child_hash, depth - 1,
+                             -alpha - 1, -alpha, player == 1 ? 0 : 1);
+      if (child_score > alpha && child_score < beta) {
+#ifdef COUNT_STATS
+        thread->stats.pvs_researches++;
+#endif
+        child_score = -minimax(thread, nullptr, board, child_hash, depth - 1,
+                               -beta, -alpha, player == 1 ? 0 : 1);
+      }
+    }
+    board_undo_move(board, move, flips, player);
+    if (thread->nnue != nullptr)
+      nnue_undo_move(thread->nnue, &thread->accumulator, move, flips, player);
+    if (thread->aborted) {
+      return 0;
     }
-    // run minimax on move
-    auto child_score =
-        -minimax(nullptr, &board, move, depth - 1, -beta, -alpha,
-                 player == 1 ? 0 : 1, hash_table, start_time, search_time);
     if (child_score > value) {
       value = child_score;
       best_move = move;
@@ -137,13 +285,18 @@ static inline int32_t minimax(move_t *dst_best_move, board_t *old_board,
     // adjust alpha and cutoff
     alpha = std::max(alpha, value);
     if (alpha >= beta) {
+#ifdef COUNT_STATS
+      thread->stats.beta_cutoffs++;
+      if (first_child)
+        thread->stats.first_move_cutoffs++;
+#endif
+      move_order_cutoff(&thread->order, move, player, depth, ply);
       break;
     }
   }
   // create entry in hash table
   hash_entry_t new_entry;
   memset(&new_entry, 0, sizeof(hash_entry_t));
-  new_entry.age = 0;
   new_entry.depth = depth;
   new_entry.value = value;
   new_entry.flags = HASH_TABLE_FLAGS_USED;
@@ -154,10 +307,10 @@ static inline int32_t minimax(move_t *dst_best_move, board_t *old_board,
   } else {
     new_entry.flags |= BOUND_TYPE_EXACT;
   }
-  memcpy(&new_entry.board.players, &board.players, sizeof(board.players));
-  new_entry.best_move = best_move;
+  new_entry.hash = key;
+  new_entry.best_move = move_transform(best_move, symmetry);
   // insert entry into hash table
-  hash_table_insert(hash_table, &new_entry);
+  hash_table_insert(thread->hash_table, &new_entry);
 
   assert(best_move != 255);
   if (dst_best_move != nullptr) {
@@ -167,31 +320,237 @@ static inline int32_t minimax(move_t *dst_best_move, board_t *old_board,
   return value;
 }
 
-int32_t get_move(move_t *dst_res_move, board_t *board, color_t player,
-                 hash_table_t hash_table, double search_time) {
-  int32_t final_score;
-  // get start time
-  time_t start = time(nullptr);
-  // run iterative deepening
-  for (int cur_depth = 1; true; cur_depth++) {
-#ifdef COUNT_STATS
-    minimax_depth = cur_depth;
-#endif
-    try {
-      final_score = minimax(dst_res_move, board, 255, cur_depth, -MINIMAX_INF,
-                            +MINIMAX_INF, 0, hash_table, &start, search_time);
-      if (final_score > EVAL_INF || final_score < -EVAL_INF)
+/* search the root to the given depth, starting with a window around guess if
+ * aspiration windows are enabled
+ * dst_res_move is only written by a search that didn't fail low */
+static int32_t search_root(search_thread_t *thread, move_t *dst_res_move,
+                           board_t *board, int depth, int32_t guess,
+                           bool use_guess) {
+  int32_t delta = ASPIRATION_WINDOW;
+  int32_t alpha = -MINIMAX_INF;
+  int32_t beta = +MINIMAX_INF;
+  if (use_guess && thread->config->aspiration) {
+    alpha = guess - delta;
+    beta = guess + delta;
+  }
+
+  thread->root_depth = depth;
+  // the rest of the search updates the hash along with the board
+  auto hash = hash_board(board, thread->root_player);
+  while (true) {
+    move_t move = 255;
+    auto score = minimax(thread, &move, board, hash, depth, alpha, beta,
+                         thread->root_player);
+    if (thread->aborted) {
+      return 0;
+    }
+    bool fail_low = score <= alpha && alpha > -MINIMAX_INF;
+    bool fail_high = score >= beta && beta < +MINIMAX_INF;
+    if (!fail_low) {
+      *dst_res_move = move;
+    }
+    if (!fail_low && !fail_high) {
+      return score;
+    }
+
+#ifdef COUNT_STATS
+    thread->stats.aspiration_researches++;
+#endif
+    delta *= ASPIRATION_WIDEN;
+    if (fail_low) {
+      alpha = delta > ASPIRATION_MAX_WINDOW ? -MINIMAX_INF : score - delta;
+    } else {
+      beta = delta > ASPIRATION_MAX_WINDOW ? +MINIMAX_INF : score + delta;
+    }
+  }
+}
+
+/* run iterative deepening on one thread until the position is solved, the
+ * search is stopped, or (thread 0) the time allocation says to stop */
+static int32_t search_thread_run(search_thread_t *thread, move_t *dst_res_move,
+                                 const board_t *root) {
+  // the search makes and undoes moves on the board, so each thread needs its
+  // own copy
+  board_t board = *root;
+  if (thread->nnue != nullptr)
+    nnue_refresh(thread->nnue, &board, &thread->accumulator);
+  int32_t final_score = 0;
+  move_t last_move = 255;
+  int stable_iterations = 0;
+  auto empties = 64 - bits_popcount(board.players[0] | board.players[1]);
+  // helpers with odd ids start (and stay) one ply ahead of thread 0
+  for (int cur_depth = 1 + (thread->id & 1); true; cur_depth++) {
+    // within reach of the endgame solver, only search shallow enough to order
+    // the moves before solving
+    if (empties <= thread->config->endgame_empties &&
+        cur_depth > ENDGAME_PRESEARCH_DEPTH) {
+      cur_depth = std::max(cur_depth, (int)empties);
+    }
+#ifdef COUNT_STATS
+    thread->stats.minimax_depth = cur_depth;
+#endif
+    auto score = search_root(thread, dst_res_move, &board, cur_depth,
+                             final_score, cur_depth > 1 + (thread->id & 1));
+    if (thread->aborted) {
+      if (thread->id == 0 && !thread->ponder)
+        printf("Time Up                    \n");
+      break;
+    }
+    final_score = score;
+    if (empties <= thread->config->endgame_empties) {
+      // the endgame solver took over at the root, so the result is exact
+      // (the shallow searches before it can get a score beyond EVAL_INF from
+      // a bound the solver left in the table, which isn't a solved score)
+      if (cur_depth >= empties)
         break;
-    } catch (const OthelloTimeUp &e) {
-      printf("Time Up                    \n");
+    } else if (final_score > EVAL_INF || final_score < -EVAL_INF) {
       break;
     }
+
+    if (thread->max_depth > 0 && cur_depth >= thread->max_depth)
+      break;
+
+    if (thread->id == 0 && thread->deadline != nullptr) {
+      stable_iterations = *dst_res_move == last_move ? stable_iterations + 1 : 0;
+      last_move = *dst_res_move;
+
+      // stop early if the next iteration is unlikely to finish in the target
+      // time, or if the best move has settled
+      auto elapsed = search_deadline_elapsed_ms(thread->deadline);
+      auto target = thread->deadline->target_ms;
+      if (elapsed * 2 >= target ||
+          (stable_iterations >= TIME_STABLE_ITERATIONS &&
+           elapsed * 4 >= target)) {
+        break;
+      }
+    }
+  }
+
+  return final_score;
+}
+
+/* run the search threads on board until thread 0 is done or stop is set
+ * searches without a deadline (pondering, fixed depth) have no time limit */
+static int32_t search_run(move_t *dst_res_move, board_t *board, color_t player,
+                          hash_table_t hash_table,
+                          const search_deadline_t *deadline, int max_depth,
+                          bool ponder, const search_config_t *config,
+                          std::atomic<bool> *stop, search_stats_t *stats) {
+  auto start = search_clock_t::now();
+
+  int num_threads = std::max(config->threads, 1);
+  // a root within the endgame solver's reach is solved by splitting nodes
+  // between the threads instead of lazy smp
+  auto empties = 64 - bits_popcount(board->players[0] | board->players[1]);
+  bool split = num_threads > 1 && empties <= config->endgame_empties;
+  std::vector<split_deque_t> deques(num_threads);
+  split_pool_t pool;
+  pool.num_deques = num_threads;
+  pool.deques = deques.data();
+  pool.queued.store(0, std::memory_order_relaxed);
+
+  std::vector<search_thread_t> threads(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    threads[i].id = i;
+    threads[i].config = config;
+    threads[i].hash_table = hash_table;
+    threads[i].stop = stop;
+    threads[i].ponder = ponder;
+    threads[i].aborted = false;
+    threads[i].board_i = 0;
+    threads[i].check_interval = TIME_CHECK_MIN_BOARDS;
+    threads[i].last_check = start;
+    threads[i].last_print = start;
+    threads[i].deadline = deadline;
+    threads[i].max_depth = max_depth;
+    threads[i].root_player = player;
+    move_order_reset(&threads[i].order);
+    threads[i].nnue = evaluator_nnue();
+    threads[i].pool = split ? &pool : nullptr;
+    threads[i].split = nullptr;
+    stats_reset(&threads[i].stats);
+    threads[i].stats.search_threads = 1;
+  }
+
+  // start helpers, then run thread 0 on this thread
+  std::vector<std::thread> helpers;
+  std::vector<move_t> helper_moves(num_threads);
+  for (int i = 1; i < num_threads; i++) {
+    if (split) {
+      helpers.emplace_back(endgame_split_worker, &threads[i]);
+    } else {
+      helpers.emplace_back(search_thread_run, &threads[i], &helper_moves[i],
+                           board);
+    }
+  }
+  int32_t final_score = search_thread_run(&threads[0], dst_res_move, board);
+
+  stop->store(true, std::memory_order_relaxed);
+  for (auto &helper : helpers) {
+    helper.join();
   }
 
-  /* if search ended early, wait */
-  if (difftime(time(nullptr), start) < search_time) {
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+  stats_reset(stats);
+  for (auto &thread : threads) {
+    stats_merge(stats, &thread.stats);
   }
+  // the reported depth is the one the returned move came from
+  stats->minimax_depth = threads[0].stats.minimax_depth;
+  stats->search_time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              search_clock_t::now() - start)
+                              .count();
 
   return final_score;
 }
+
+int32_t get_move(move_t *dst_res_move, board_t *board, color_t player,
+                 hash_table_t hash_table, const search_deadline_t *deadline,
+                 const search_config_t *config, search_stats_t *stats) {
+  std::atomic<bool> stop(false);
+  return search_run(dst_res_move, board, player, hash_table, deadline, 0,
+                    false, config, &stop, stats);
+}
+
+int32_t get_move_depth(move_t *dst_res_move, board_t *board, color_t player,
+                       hash_table_t hash_table, int depth,
+                       const search_config_t *config, search_stats_t *stats) {
+  // the deepening skips to the solve once past the presearch depth
+  int empties = 64 - bits_popcount(board->players[0] | board->players[1]);
+  if (empties <= config->endgame_empties)
+    depth = std::max(depth, empties);
+  std::atomic<bool> stop(false);
+  return search_run(dst_res_move, board, player, hash_table, nullptr, depth,
+                    false, config, &stop, stats);
+}
+
+int32_t search_depth(board_t *board, color_t player, hash_table_t hash_table,
+                     int depth, const search_config_t *config,
+                     search_stats_t *stats) {
+  std::atomic<bool> stop(false);
+  move_t move;
+  return search_run(&move, board, player, hash_table, nullptr, depth, false,
+                    config, &stop, stats);
+}
+
+static void ponder_run(ponder_t *ponder, color_t player,
+                       hash_table_t hash_table,
+                       const search_config_t *config) {
+  move_t move;
+  ponder->score = search_run(&move, &ponder->board, player, hash_table,
+                             nullptr, 0, true, config, &ponder->stop,
+                             &ponder->stats);
+}
+
+void ponder_start(ponder_t *ponder, board_t *board, color_t player,
+                  hash_table_t hash_table, const search_config_t *config) {
+  ponder->board = *board;
+  ponder->score = 0;
+  ponder->stop.store(false, std::memory_order_relaxed);
+  ponder->thread =
+      std::thread(ponder_run, ponder, player, hash_table, config);
+}
+
+void ponder_stop(ponder_t *ponder) {
+  ponder->stop.store(true, std::memory_order_relaxed);
+  ponder->thread.join();
+}
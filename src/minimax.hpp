@@ -3,10 +3,86 @@
 #include "bitboard.hpp"
 #include "evaluator.hpp"
 #include "hash_table.hpp"
-#include <ctime>
+#include "probcut.hpp"
+#include "stats.hpp"
+#include "time_control.hpp"
+#include <atomic>
+#include <thread>
+
+typedef struct {
+  /* number of threads to search with (lazy smp over the shared table) */
+  int threads;
+  /* search moves after the first with a null window (principal variation
+   * search), and only re-search them with the full window if they fail high */
+  bool pvs;
+  /* start each iteration with a narrow window around the previous score,
+   * widening it when the search fails low or high */
+  bool aspiration;
+  /* number of empty squares at which the endgame solver takes over (once the
+   * search would reach the end of the game anyway), 0 to disable it */
+  int endgame_empties;
+  /* keep searching on the opponent's time */
+  bool ponder;
+  /* multi-probcut selectivity level for each game phase, 0 for a full width
+   * search */
+  int probcut[PROBCUT_PHASES];
+  /* before searching a node's moves, look all of its children up in the table
+   * and cut if one of them already refutes the node (enhanced transposition
+   * cutoff) */
+  bool etc;
+  /* cut nodes where the opponent has so many stable pieces that even the best
+   * possible final score can't reach alpha */
+  bool stability;
+  /* key table entries on the canonical orientation of each board, so that a
+   * position and its mirror images share one entry */
+  bool symmetry;
+} search_config_t;
+
+/**
+ * A background search on the opponent's time
+ * The search runs from the board after our move, with the opponent to move, so
+ * the table fills up with the replies alpha-beta considers most likely (the
+ * predicted reply gets the full window). If the opponent plays one of them, the
+ * next get_move starts with a deep table. */
+typedef struct {
+  board_t board;
+  std::atomic<bool> stop;
+  std::thread thread;
+  // score for the player to move at the ponder root
+  int32_t score;
+  search_stats_t stats;
+} ponder_t;
 
 /**
  * Get a move from the given board
- * search to the given depth */
+ * search until the deadline says to stop or the game is solved
+ * search statistics are written to stats */
 int32_t get_move(move_t *dst_res_move, board_t *board, color_t player,
-                 hash_table_t hash_table, double search_time);
+                 hash_table_t hash_table, const search_deadline_t *deadline,
+                 const search_config_t *config, search_stats_t *stats);
+
+/**
+ * Get a move from the given board, searching to exactly the given depth, or
+ * solving the board if it is within the endgame solver's reach
+ * returns the score for player (exact if the board was solved) */
+int32_t get_move_depth(move_t *dst_res_move, board_t *board, color_t player,
+                       hash_table_t hash_table, int depth,
+                       const search_config_t *config, search_stats_t *stats);
+
+/**
+ * Search board to exactly the given depth, without a time limit
+ * returns the score for player */
+int32_t search_depth(board_t *board, color_t player, hash_table_t hash_table,
+                     int depth, const search_config_t *config,
+                     search_stats_t *stats);
+
+/**
+ * Start pondering on board (with player to move) in the background
+ * The search shares hash_table, so the table must not be aged or cleared until
+ * ponder_stop returns */
+void ponder_start(ponder_t *ponder, board_t *board, color_t player,
+                  hash_table_t hash_table, const search_config_t *config);
+
+/* stop pondering, and wait for the search threads to finish
+ * ponder->stats holds the statistics of the ponder search afterwards */
+void ponder_stop(ponder_t *ponder);
@@ -0,0 +1,88 @@
+#include "move_order.hpp"
+#include <cassert>
+#include <cstring>
+
+// key offsets for each ordering stage (larger keys are searched first)
+#define MOVE_ORDER_TT_KEY (1 << 30)
+#define MOVE_ORDER_KILLER_KEY (1 << 22)
+#define MOVE_ORDER_SQUARE_SHIFT 18
+#define MOVE_ORDER_MOBILITY_SHIFT 14
+// history is halved once an entry grows past this
+#define MOVE_ORDER_HISTORY_MAX (1 << 16)
+
+/* static priority of each square
+ * corners are almost always good, and the squares next to them (C and X
+ * squares) usually give the corner away */
+static const int8_t move_order_square_class[64] = {
+    3,  -2, 1, 0, 0, 1, -2, 3,  /* 1 */
+    -2, -3, 0, 0, 0, 0, -3, -2, /* 2 */
+    1,  0,  1, 0, 0, 1, 0,  1,  /* 3 */
+    0,  0,  0, 0, 0, 0, 0,  0,  /* 4 */
+    0,  0,  0, 0, 0, 0, 0,  0,  /* 5 */
+    1,  0,  1, 0, 0, 1, 0,  1,  /* 6 */
+    -2, -3, 0, 0, 0, 0, -3, -2, /* 7 */
+    3,  -2, 1, 0, 0, 1, -2, 3,  /* 8 */
+};
+
+void move_order_reset(move_order_t *order) {
+  memset(order->history, 0, sizeof(order->history));
+  memset(order->killers, 255, sizeof(order->killers));
+}
+
+void move_order_gen(move_order_t *order, move_list_t *list, board_t *board,
+                    bitboard_t moves, color_t player, int depth, int ply,
+                    move_t tt_move, bool reverse) {
+  bool by_mobility = depth >= MOVE_ORDER_MOBILITY_DEPTH;
+  move_t *killers = ply < MOVE_ORDER_MAX_PLY ? order->killers[ply] : nullptr;
+
+  list->count = 0;
+  while (moves) {
+    move_t move = reverse ? bitboard_get_and_clear_last_move(&moves)
+                          : bitboard_get_and_clear_first_move(&moves);
+
+    int32_t key;
+    if (move == tt_move) {
+      key = MOVE_ORDER_TT_KEY;
+    } else {
+      key = move_order_square_class[move] * (1 << MOVE_ORDER_SQUARE_SHIFT) +
+            order->history[player][move];
+      if (killers != nullptr && move == killers[0]) {
+        key += 2 * MOVE_ORDER_KILLER_KEY;
+      } else if (killers != nullptr && move == killers[1]) {
+        key += MOVE_ORDER_KILLER_KEY;
+      }
+      if (by_mobility) {
+        board_t child = *board;
+        board_make_move(&child, move, player);
+        key -= bits_popcount(board_gen_moves(&child, !player))
+               << MOVE_ORDER_MOBILITY_SHIFT;
+      }
+    }
+
+    // insertion sort, keeping generation order for equal keys
+    int i = list->count++;
+    assert(i < MOVE_LIST_MAX);
+    for (; i > 0 && list->keys[i - 1] < key; i--) {
+      list->moves[i] = list->moves[i - 1];
+      list->keys[i] = list->keys[i - 1];
+    }
+    list->moves[i] = move;
+    list->keys[i] = key;
+  }
+}
+
+void move_order_cutoff(move_order_t *order, move_t move, color_t player,
+                       int depth, int ply) {
+  if (ply < MOVE_ORDER_MAX_PLY && order->killers[ply][0] != move) {
+    order->killers[ply][1] = order->killers[ply][0];
+    order->killers[ply][0] = move;
+  }
+
+  int32_t *history = order->history[player];
+  history[move] += depth * depth;
+  if (history[move] > MOVE_ORDER_HISTORY_MAX) {
+    for (int i = 0; i < 64; i++) {
+      history[i] /= 2;
+    }
+  }
+}
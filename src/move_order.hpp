@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include <cstdint>
+
+/**
+ * Move Ordering
+ * Alpha-beta cuts off the most when the best move is searched first. Moves are
+ * generated into a small list and sorted by:
+ * - the best move from the transposition table
+ * - killer moves (moves that caused a cutoff at the same ply elsewhere)
+ * - static square class (corners first, squares next to corners last)
+ * - the history table (how often, and how deep, a move has caused cutoffs)
+ * - away from the leaves, how few replies the move leaves the opponent
+ */
+
+// maximum number of legal moves in a position (known max is 33)
+#define MOVE_LIST_MAX 40
+// plies tracked by the killer table
+#define MOVE_ORDER_MAX_PLY 64
+// at or above this remaining depth, moves are ordered by opponent mobility
+// (closer to the leaves, making each move costs more than it saves)
+#define MOVE_ORDER_MOBILITY_DEPTH 4
+
+typedef struct {
+  move_t moves[MOVE_LIST_MAX];
+  int32_t keys[MOVE_LIST_MAX];
+  int count;
+} move_list_t;
+
+/* per thread ordering state */
+typedef struct {
+  // indexed as [color][move]
+  int32_t history[2][64];
+  // indexed as [ply][slot], 255 if empty
+  move_t killers[MOVE_ORDER_MAX_PLY][2];
+} move_order_t;
+
+/* reset history and killers */
+void move_order_reset(move_order_t *order);
+
+/**
+ * Fill list with the moves in the moves bitboard (legal moves for player on
+ * board), best first
+ * tt_move is searched first if it is in moves (255 if none)
+ * if reverse is set, equally ranked moves are visited from h8 down */
+void move_order_gen(move_order_t *order, move_list_t *list, board_t *board,
+                    bitboard_t moves, color_t player, int depth, int ply,
+                    move_t tt_move, bool reverse);
+
+/* record that move caused a beta cutoff */
+void move_order_cutoff(move_order_t *order, move_t move, color_t player,
+                       int depth, int ply);
@@ -0,0 +1,256 @@
+#include "bitboard.hpp"
+#include "evaluator.hpp"
+#include "hash_table.hpp"
+#include "minimax.hpp"
+#include "probcut.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/**
+ * Multi-ProbCut calibration
+ * sample: searches random positions to every depth up to MAX_DEPTH, and
+ * appends the scores to FILE, one position per line:
+ *   empties score_1 score_2 ... score_MAX_DEPTH
+ * fit: fits the probcut parameters of each phase and depth pair to the samples
+ * in FILE, and writes them as a header to be compiled into the search
+ * (src/probcut_params.hpp) */
+
+// positions are sampled with this many empty squares
+#define CALIBRATE_MIN_EMPTIES 12
+#define CALIBRATE_MAX_EMPTIES 58
+// depth pairs with fewer samples than this are left uncalibrated
+#define CALIBRATE_MIN_SAMPLES 32
+
+typedef struct {
+  int empties;
+  std::vector<int32_t> scores;
+} calibrate_sample_t;
+
+void print_usage(const char *name) {
+  printf("Usage: %s sample FILE POSITIONS MAX_DEPTH [SEED [EVAL_WEIGHTS]]\n"
+         "       %s fit FILE OUTPUT\n",
+         name, name);
+  exit(1);
+}
+
+/* play random moves from the starting position until the board has the given
+ * number of empty squares, returns false if the game ended first */
+static bool random_position(board_t *board, color_t *player, int empties) {
+  memset(board, 0, sizeof(board_t));
+  board_set_cell(board, 27, 0);
+  board_set_cell(board, 36, 0);
+  board_set_cell(board, 28, 1);
+  board_set_cell(board, 35, 1);
+  *player = 0;
+
+  while (64 - bits_popcount(board->players[0] | board->players[1]) > empties) {
+    bitboard_t moves = board_gen_moves(board, *player);
+    if (!moves) {
+      *player = !*player;
+      moves = board_gen_moves(board, *player);
+      if (!moves)
+        return false;
+    }
+    int n = rand() % bits_popcount(moves);
+    move_t move = bitboard_get_and_clear_first_move(&moves);
+    for (int i = 0; i < n; i++)
+      move = bitboard_get_and_clear_first_move(&moves);
+    board_make_move(board, move, *player);
+    *player = !*player;
+  }
+  // the searched side needs a move
+  if (!board_gen_moves(board, *player))
+    *player = !*player;
+  return board_gen_moves(board, *player) != 0;
+}
+
+static int calibrate_sample(const char *file, int positions, int max_depth) {
+  FILE *out = fopen(file, "a");
+  if (out == nullptr) {
+    perror(file);
+    return 1;
+  }
+
+  hash_table_t hash_table;
+  if (!hash_table_alloc(&hash_table, HASH_TABLE_DEFAULT_MB)) {
+    printf("Could not allocate the transposition table\n");
+    fclose(out);
+    return 1;
+  }
+  // a plain full width search, without the endgame solver
+  search_config_t config = {1,     true,      false, 0,    false,
+                            {0, 0, 0}, false, false, false};
+
+  for (int i = 0; i < positions; i++) {
+    board_t board;
+    color_t player;
+    int empties = CALIBRATE_MIN_EMPTIES +
+                  rand() % (CALIBRATE_MAX_EMPTIES - CALIBRATE_MIN_EMPTIES + 1);
+    if (!random_position(&board, &player, empties)) {
+      i--;
+      continue;
+    }
+
+    hash_table_clear(&hash_table);
+    fprintf(out, "%i", empties);
+    for (int depth = 1; depth <= max_depth; depth++) {
+      search_stats_t stats;
+      fprintf(out, " %i",
+              search_depth(&board, player, hash_table, depth, &config, &stats));
+    }
+    fprintf(out, "\n");
+    fflush(out);
+    printf("Sampled %i / %i    \r", i + 1, positions);
+    fflush(stdout);
+  }
+  printf("\n");
+
+  hash_table_free(&hash_table);
+  fclose(out);
+  return 0;
+}
+
+/* least squares fit of deep = a * shallow + b, and the deviation of the error
+ * returns false if there aren't enough samples */
+static bool calibrate_fit_pair(const std::vector<calibrate_sample_t> &samples,
+                               int phase, int shallow, int deep,
+                               probcut_param_t *dst) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (auto &sample : samples) {
+    if (probcut_phase(sample.empties) != phase ||
+        (int)sample.scores.size() < deep)
+      continue;
+    double x = sample.scores[shallow - 1], y = sample.scores[deep - 1];
+    // won / lost positions aren't predicted by the evaluation
+    if (fabs(x) >= EVAL_INF || fabs(y) >= EVAL_INF)
+      continue;
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double var = n * sxx - sx * sx;
+  if (n < CALIBRATE_MIN_SAMPLES || var <= 0)
+    return false;
+
+  double a = (n * sxy - sx * sy) / var;
+  double b = (sy - a * sx) / n;
+  double err = 0;
+  for (auto &sample : samples) {
+    if (probcut_phase(sample.empties) != phase ||
+        (int)sample.scores.size() < deep)
+      continue;
+    double x = sample.scores[shallow - 1], y = sample.scores[deep - 1];
+    if (fabs(x) >= EVAL_INF || fabs(y) >= EVAL_INF)
+      continue;
+    err += (y - a * x - b) * (y - a * x - b);
+  }
+
+  dst->a = (float)a;
+  dst->b = (float)b;
+  dst->sigma = (float)sqrt(err / (n - 2));
+  return a > 0;
+}
+
+static int calibrate_fit(const char *file, const char *output) {
+  FILE *in = fopen(file, "r");
+  if (in == nullptr) {
+    perror(file);
+    return 1;
+  }
+
+  // read samples
+  std::vector<calibrate_sample_t> samples;
+  int max_depth = 0;
+  char line[4096];
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    calibrate_sample_t sample;
+    char *cur = line, *end;
+    sample.empties = (int)strtol(cur, &end, 10);
+    if (end == cur)
+      continue;
+    for (cur = end;; cur = end) {
+      long score = strtol(cur, &end, 10);
+      if (end == cur)
+        break;
+      sample.scores.push_back((int32_t)score);
+    }
+    max_depth = std::max(max_depth, (int)sample.scores.size());
+    samples.push_back(sample);
+  }
+  fclose(in);
+
+  int calibrated_depth = std::min(max_depth, PROBCUT_MAX_DEPTH);
+  if (calibrated_depth < PROBCUT_MIN_DEPTH) {
+    fprintf(stderr, "%s: samples must go to at least depth %i\n", file,
+            PROBCUT_MIN_DEPTH);
+    return 1;
+  }
+
+  FILE *out = fopen(output, "w");
+  if (out == nullptr) {
+    perror(output);
+    return 1;
+  }
+  fprintf(out,
+          "#pragma once\n\n"
+          "#include \"probcut.hpp\"\n\n"
+          "/* multi-probcut parameters (a, b, sigma), indexed as\n"
+          " * [phase][deep depth][check]\n"
+          " * generated by othello_mpc_calibrate from %zu positions */\n\n"
+          "#define PROBCUT_CALIBRATED_DEPTH %i\n\n"
+          "static const probcut_param_t\n"
+          "    probcut_param_table[PROBCUT_PHASES][PROBCUT_CALIBRATED_DEPTH + "
+          "1]\n"
+          "                       [PROBCUT_CHECKS] = {\n",
+          samples.size(), calibrated_depth);
+  for (int phase = 0; phase < PROBCUT_PHASES; phase++) {
+    fprintf(out, "        {\n");
+    for (int depth = 0; depth <= calibrated_depth; depth++) {
+      fprintf(out, "            {");
+      for (int check = 0; check < PROBCUT_CHECKS; check++) {
+        probcut_param_t param = {0.0f, 0.0f, 0.0f};
+        int shallow = probcut_shallow_depth(depth, check);
+        if (shallow == 0 ||
+            !calibrate_fit_pair(samples, phase, shallow, depth, &param)) {
+          param = {0.0f, 0.0f, 0.0f};
+        } else {
+          printf("phase %i, depth %2i from %2i: a %.3f, b %7.2f, sigma %7.2f\n",
+                 phase, depth, shallow, param.a, param.b, param.sigma);
+        }
+        fprintf(out, "%s{%.4ff, %.4ff, %.4ff}", check > 0 ? ", " : "",
+                param.a, param.b, param.sigma);
+      }
+      fprintf(out, "},\n");
+    }
+    fprintf(out, "        },\n");
+  }
+  fprintf(out, "};\n");
+  fclose(out);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4)
+    print_usage(argv[0]);
+
+
+  if (strcmp(argv[1], "sample") == 0 && argc >= 5) {
+    srand(argc >= 6 ? (unsigned)strtoul(argv[5], nullptr, 10) : 1);
+    // the scores of the evaluation the parameters will be used with
+    if (argc >= 7 && !evaluator_load_patterns(argv[6])) {
+      printf("Could not load pattern weights from %s\n", argv[6]);
+      return 1;
+    }
+    return calibrate_sample(argv[2], (int)strtol(argv[3], nullptr, 10),
+                            (int)strtol(argv[4], nullptr, 10));
+  } else if (strcmp(argv[1], "fit") == 0) {
+    return calibrate_fit(argv[2], argv[3]);
+  }
+  print_usage(argv[0]);
+}
@@ -0,0 +1,402 @@
+#include "nnue.hpp"
+#include "evaluator.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// dividing a second layer sum by NNUE_WEIGHT_SCALE brings it back to the
+// scale of the clipped values (rounding down; the clipping makes that the
+// same as rounding towards zero)
+#define NNUE_WEIGHT_SHIFT 6
+static_assert(1 << NNUE_WEIGHT_SHIFT == NNUE_WEIGHT_SCALE,
+              "NNUE_WEIGHT_SHIFT doesn't match NNUE_WEIGHT_SCALE");
+
+void nnue_prepare(nnue_t *net) {
+  // flipping a square to player takes away the opponent's input, and adds
+  // player's
+  for (int player = 0; player < 2; player++) {
+    for (int square = 0; square < 64; square++) {
+      const int16_t *add = net->input_weights[player * 64 + square];
+      const int16_t *sub = net->input_weights[(1 - player) * 64 + square];
+      for (int h = 0; h < NNUE_HIDDEN1; h++)
+        net->flip_weights[player][square][h] = (int16_t)(add[h] - sub[h]);
+    }
+  }
+}
+
+/* the evaluation can't claim a board is won or lost, whatever the weights */
+static inline int32_t nnue_clamp_output(int32_t output) {
+  return std::max(-(EVAL_INF - 1), std::min(EVAL_INF - 1, output));
+}
+
+/* --- scalar kernels --- */
+
+CPU_KERNEL void scalar_add_row(int16_t *values, const int16_t *row,
+                               bool subtract) {
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    values[h] = (int16_t)(subtract ? values[h] - row[h] : values[h] + row[h]);
+}
+
+CPU_KERNEL void scalar_nnue_refresh(const nnue_t *net, board_t *board,
+                                    nnue_accumulator_t *acc) {
+  memcpy(acc->values, net->input_bias, sizeof(acc->values));
+  for (int player = 0; player < 2; player++) {
+    bitboard_t pieces = board->players[player];
+    while (pieces) {
+      scalar_add_row(
+          acc->values,
+          net->input_weights[player * 64 + bits_index_of_first_set(pieces)],
+          false);
+      pieces &= pieces - 1;
+    }
+  }
+}
+
+CPU_KERNEL void scalar_nnue_update(const nnue_t *net,
+                                   nnue_accumulator_t *acc, move_t move,
+                                   bitboard_t flips, color_t player,
+                                   bool subtract) {
+  scalar_add_row(acc->values, net->input_weights[player * 64 + move],
+                 subtract);
+  while (flips) {
+    scalar_add_row(acc->values,
+                   net->flip_weights[player][bits_index_of_first_set(flips)],
+                   subtract);
+    flips &= flips - 1;
+  }
+}
+
+CPU_KERNEL int32_t scalar_nnue_evaluate(const nnue_t *net,
+                                        const nnue_accumulator_t *acc) {
+  int32_t hidden1[NNUE_HIDDEN1];
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    hidden1[h] = std::max(0, std::min(NNUE_ONE, (int32_t)acc->values[h]));
+
+  int32_t output = net->output_bias;
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    int32_t sum = net->hidden_bias[j];
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      sum += hidden1[h] * net->hidden_weights[j][h];
+    int32_t hidden2 =
+        std::max(0, std::min(NNUE_ONE, sum >> NNUE_WEIGHT_SHIFT));
+    output += hidden2 * net->output_weights[j];
+  }
+  return nnue_clamp_output(output);
+}
+
+/* --- avx2 kernels ---
+ * The accumulator is four vectors of 16 values, kept in registers while all
+ * the rows of a move are added. The second layer multiplies the clipped
+ * values (as unsigned bytes) with its int8 weights 32 at a time
+ * (maddubs), and the third multiplies the int32 hidden values with its
+ * weights as int16 pairs (madd, the high halves being 0). Results are the
+ * same as the scalar kernels: no sum of two byte products gets near the int16
+ * limit, and every other sum is exact. */
+
+#ifdef CPU_X86
+#define AVX2_VECTORS (NNUE_HIDDEN1 / 16)
+// unless the loops over the vectors are unrolled, gcc keeps the accumulator
+// on the stack (in 128 bit halves) instead of in registers
+#define AVX2_UNROLL _Pragma("GCC unroll 4")
+
+CPU_KERNEL CPU_TARGET_AVX2 void avx2_add_row(__m256i *values,
+                                             const int16_t *row,
+                                             bool subtract) {
+  const __m256i *vectors = reinterpret_cast<const __m256i *>(row);
+  AVX2_UNROLL
+  for (int v = 0; v < AVX2_VECTORS; v++) {
+    __m256i x = _mm256_load_si256(&vectors[v]);
+    values[v] = subtract ? _mm256_sub_epi16(values[v], x)
+                         : _mm256_add_epi16(values[v], x);
+  }
+}
+
+CPU_KERNEL CPU_TARGET_AVX2 void avx2_store(nnue_accumulator_t *acc,
+                                           const __m256i *values) {
+  __m256i *dst = reinterpret_cast<__m256i *>(acc->values);
+  AVX2_UNROLL
+  for (int v = 0; v < AVX2_VECTORS; v++)
+    _mm256_store_si256(&dst[v], values[v]);
+}
+
+CPU_KERNEL CPU_TARGET_AVX2 void avx2_nnue_refresh(const nnue_t *net,
+                                                  board_t *board,
+                                                  nnue_accumulator_t *acc) {
+  __m256i values[AVX2_VECTORS];
+  const __m256i *bias = reinterpret_cast<const __m256i *>(net->input_bias);
+  AVX2_UNROLL
+  for (int v = 0; v < AVX2_VECTORS; v++)
+    values[v] = _mm256_load_si256(&bias[v]);
+  for (int player = 0; player < 2; player++) {
+    bitboard_t pieces = board->players[player];
+    while (pieces) {
+      avx2_add_row(
+          values,
+          net->input_weights[player * 64 + bits_index_of_first_set(pieces)],
+          false);
+      pieces &= pieces - 1;
+    }
+  }
+  avx2_store(acc, values);
+}
+
+CPU_KERNEL CPU_TARGET_AVX2 void avx2_nnue_update(const nnue_t *net,
+                                                 nnue_accumulator_t *acc,
+                                                 move_t move, bitboard_t flips,
+                                                 color_t player,
+                                                 bool subtract) {
+  __m256i values[AVX2_VECTORS];
+  const __m256i *src = reinterpret_cast<const __m256i *>(acc->values);
+  AVX2_UNROLL
+  for (int v = 0; v < AVX2_VECTORS; v++)
+    values[v] = _mm256_load_si256(&src[v]);
+  avx2_add_row(values, net->input_weights[player * 64 + move], subtract);
+  while (flips) {
+    avx2_add_row(values,
+                 net->flip_weights[player][bits_index_of_first_set(flips)],
+                 subtract);
+    flips &= flips - 1;
+  }
+  avx2_store(acc, values);
+}
+
+/* the sums of the lanes of each of 8 vectors, as one vector */
+CPU_KERNEL CPU_TARGET_AVX2 __m256i avx2_sum_lanes(const __m256i *v) {
+  __m256i s01 = _mm256_hadd_epi32(v[0], v[1]);
+  __m256i s23 = _mm256_hadd_epi32(v[2], v[3]);
+  __m256i s45 = _mm256_hadd_epi32(v[4], v[5]);
+  __m256i s67 = _mm256_hadd_epi32(v[6], v[7]);
+  // the low 128 bits hold the sums of the low halves of v[0..3], the high
+  // ones of the high halves
+  __m256i s0123 = _mm256_hadd_epi32(s01, s23);
+  __m256i s4567 = _mm256_hadd_epi32(s45, s67);
+  return _mm256_add_epi32(_mm256_permute2x128_si256(s0123, s4567, 0x20),
+                          _mm256_permute2x128_si256(s0123, s4567, 0x31));
+}
+
+CPU_KERNEL CPU_TARGET_AVX2 int32_t
+avx2_nnue_evaluate(const nnue_t *net, const nnue_accumulator_t *acc) {
+  static_assert(NNUE_HIDDEN1 == 64 && NNUE_HIDDEN2 % 8 == 0,
+                "the avx2 kernel reads the first layer as two byte vectors");
+  const __m256i *values = reinterpret_cast<const __m256i *>(acc->values);
+  __m256i one = _mm256_set1_epi16(NNUE_ONE);
+  // clip to [0, NNUE_ONE] (packus clips below 0) as bytes; packus interleaves
+  // the 128 bit halves of its operands, the permute puts them back in order
+  __m256i hidden1[2];
+  for (int i = 0; i < 2; i++) {
+    __m256i lo = _mm256_min_epi16(_mm256_load_si256(&values[2 * i]), one);
+    __m256i hi = _mm256_min_epi16(_mm256_load_si256(&values[2 * i + 1]), one);
+    hidden1[i] = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xd8);
+  }
+
+  __m256i ones = _mm256_set1_epi16(1);
+  __m256i zero = _mm256_setzero_si256();
+  __m256i clip = _mm256_set1_epi32(NNUE_ONE);
+  __m256i output = _mm256_setzero_si256();
+  for (int j = 0; j < NNUE_HIDDEN2; j += 8) {
+    __m256i sums[8];
+    for (int k = 0; k < 8; k++) {
+      const __m256i *weights =
+          reinterpret_cast<const __m256i *>(net->hidden_weights[j + k]);
+      __m256i lo = _mm256_madd_epi16(
+          _mm256_maddubs_epi16(hidden1[0], _mm256_load_si256(&weights[0])),
+          ones);
+      __m256i hi = _mm256_madd_epi16(
+          _mm256_maddubs_epi16(hidden1[1], _mm256_load_si256(&weights[1])),
+          ones);
+      sums[k] = _mm256_add_epi32(lo, hi);
+    }
+    __m256i hidden2 = _mm256_add_epi32(
+        avx2_sum_lanes(sums),
+        _mm256_load_si256(
+            reinterpret_cast<const __m256i *>(&net->hidden_bias[j])));
+    hidden2 = _mm256_srai_epi32(hidden2, NNUE_WEIGHT_SHIFT);
+    hidden2 = _mm256_min_epi32(_mm256_max_epi32(hidden2, zero), clip);
+    __m256i weights = _mm256_cvtepi8_epi32(_mm_loadl_epi64(
+        reinterpret_cast<const __m128i *>(&net->output_weights[j])));
+    output = _mm256_add_epi32(output, _mm256_madd_epi16(hidden2, weights));
+  }
+
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(output),
+                              _mm256_extracti128_si256(output, 1));
+  sum = _mm_add_epi32(sum, _mm_unpackhi_epi64(sum, sum));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 1));
+  return nnue_clamp_output(_mm_cvtsi128_si32(sum) + net->output_bias);
+}
+#endif
+
+/* --- kernel dispatch ---
+ * 64 int16 values are only two avx-512 vectors, which doesn't save enough to
+ * be worth a separate kernel, so the avx-512 variant uses the avx2 one */
+
+typedef struct {
+  void (*refresh)(const nnue_t *net, board_t *board, nnue_accumulator_t *acc);
+  void (*do_move)(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                  bitboard_t flips, color_t player);
+  void (*undo_move)(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                    bitboard_t flips, color_t player);
+  int32_t (*evaluate)(const nnue_t *net, const nnue_accumulator_t *acc);
+} nnue_kernels_t;
+
+// the kernels of one variant, compiled with its target attribute
+#define nnue_kernels_variant(name, target, prefix)                             \
+  target static void name##_refresh(const nnue_t *net, board_t *board,         \
+                                    nnue_accumulator_t *acc) {                 \
+    prefix##_nnue_refresh(net, board, acc);                                    \
+  }                                                                            \
+  target static void name##_do_move(const nnue_t *net,                         \
+                                    nnue_accumulator_t *acc, move_t move,      \
+                                    bitboard_t flips, color_t player) {        \
+    prefix##_nnue_update(net, acc, move, flips, player, false);                \
+  }                                                                            \
+  target static void name##_undo_move(const nnue_t *net,                       \
+                                      nnue_accumulator_t *acc, move_t move,    \
+                                      bitboard_t flips, color_t player) {      \
+    prefix##_nnue_update(net, acc, move, flips, player, true);                 \
+  }                                                                            \
+  target static int32_t name##_evaluate(const nnue_t *net,                     \
+                                        const nnue_accumulator_t *acc) {       \
+    return prefix##_nnue_evaluate(net, acc);                                   \
+  }
+
+nnue_kernels_variant(baseline, , scalar)
+#ifdef CPU_X86
+nnue_kernels_variant(popcnt_bmi2, CPU_TARGET_POPCNT_BMI2, scalar)
+nnue_kernels_variant(avx2, CPU_TARGET_AVX2, avx2)
+#endif
+
+#define nnue_kernels_of(name)                                                  \
+  { name##_refresh, name##_do_move, name##_undo_move, name##_evaluate }
+
+static const nnue_kernels_t nnue_kernels_variants[CPU_VARIANTS] = {
+    nnue_kernels_of(baseline),
+#ifdef CPU_X86
+    nnue_kernels_of(popcnt_bmi2),
+    nnue_kernels_of(avx2),
+    nnue_kernels_of(avx2),
+#else
+    nnue_kernels_of(baseline),
+    nnue_kernels_of(baseline),
+    nnue_kernels_of(baseline),
+#endif
+};
+
+static nnue_kernels_t nnue_kernels = nnue_kernels_variants[cpu_detect()];
+
+void nnue_select_kernels(cpu_variant_t variant) {
+  nnue_kernels = nnue_kernels_variants[variant];
+}
+
+void nnue_refresh(const nnue_t *net, board_t *board, nnue_accumulator_t *acc) {
+  nnue_kernels.refresh(net, board, acc);
+}
+
+void nnue_do_move(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                  bitboard_t flips, color_t player) {
+  nnue_kernels.do_move(net, acc, move, flips, player);
+}
+
+void nnue_undo_move(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                    bitboard_t flips, color_t player) {
+  nnue_kernels.undo_move(net, acc, move, flips, player);
+}
+
+int32_t nnue_evaluate(const nnue_t *net, const nnue_accumulator_t *acc) {
+  return nnue_kernels.evaluate(net, acc);
+}
+
+/* --- network files --- */
+
+/* start of a network file, followed by the first NNUE_FILE_BYTES of an
+ * nnue_t */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t inputs;
+  uint32_t hidden1;
+  uint32_t hidden2;
+  uint32_t checksum;
+} nnue_file_header_t;
+
+static const char nnue_file_magic[8] = {'O', 'T', 'H', 'E',
+                                        'L', 'L', 'O', 'N'};
+
+// the weights are at the start of nnue_t, without padding between them
+#define NNUE_FILE_BYTES (offsetof(nnue_t, output_bias) + sizeof(int32_t))
+static_assert(NNUE_FILE_BYTES ==
+                  sizeof(int16_t) * (NNUE_INPUTS + 1) * NNUE_HIDDEN1 +
+                      sizeof(int8_t) * NNUE_HIDDEN2 * NNUE_HIDDEN1 +
+                      sizeof(int32_t) * NNUE_HIDDEN2 +
+                      sizeof(int8_t) * NNUE_HIDDEN2 + sizeof(int32_t),
+              "nnue_t has padding between its weights");
+
+uint32_t nnue_checksum(const nnue_t *net) {
+  // fnv-1a over the weights
+  uint32_t checksum = 2166136261u;
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(net);
+  for (size_t i = 0; i < NNUE_FILE_BYTES; i++)
+    checksum = (checksum ^ bytes[i]) * 16777619u;
+  return checksum;
+}
+
+/* the header a network file of this build has */
+static nnue_file_header_t nnue_file_header(uint32_t checksum) {
+  nnue_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, nnue_file_magic, sizeof(header.magic));
+  header.version = NNUE_FILE_VERSION;
+  header.inputs = NNUE_INPUTS;
+  header.hidden1 = NNUE_HIDDEN1;
+  header.hidden2 = NNUE_HIDDEN2;
+  header.checksum = checksum;
+  return header;
+}
+
+const nnue_t *nnue_load(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr)
+    return nullptr;
+  nnue_file_header_t header;
+  nnue_t *net = new nnue_t;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            fread(net, 1, NNUE_FILE_BYTES, file) == NNUE_FILE_BYTES &&
+            fgetc(file) == EOF;
+  fclose(file);
+
+  if (ok) {
+    nnue_file_header_t expected = nnue_file_header(header.checksum);
+    ok = memcmp(&header, &expected, sizeof(expected)) == 0 &&
+         nnue_checksum(net) == header.checksum;
+  }
+  if (!ok) {
+    delete net;
+    return nullptr;
+  }
+  nnue_prepare(net);
+  return net;
+}
+
+bool nnue_save(const char *path, const nnue_t *net) {
+  // written next to the file and renamed over it once complete, like pattern
+  // weight files
+  std::string tmp_path = std::string(path) + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+
+  nnue_file_header_t header = nnue_file_header(nnue_checksum(net));
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(net, 1, NNUE_FILE_BYTES, file) == NNUE_FILE_BYTES;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
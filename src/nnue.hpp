@@ -0,0 +1,93 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include "cpu.hpp"
+#include <cstdint>
+
+/**
+ * Neural Network Evaluation
+ * A small quantized network (in the style of nnue) scores the board from the
+ * 128 inputs saying which player, if any, has a piece on each square:
+ *
+ *   128 inputs -> NNUE_HIDDEN1 (int16) -> NNUE_HIDDEN2 (int32) -> 1
+ *
+ * Each hidden value is clipped to [0, NNUE_ONE] (NNUE_ONE standing for 1.0)
+ * before it is fed to the next layer.
+ *
+ * The first layer is most of the work, but at most 64 of its inputs are set,
+ * and a move only changes a few of them (the new piece and the flips). So the
+ * search keeps its values (the accumulator) up to date as it makes and undoes
+ * moves, at the cost of one row of weights per changed square, and only runs
+ * the two small layers at the leaves.
+ *
+ * The output is in 1/PATTERN_SCALE of a piece of final difference from player
+ * 0's point of view, like pattern weights.
+ */
+
+// input i is a piece of player i / 64 on square i % 64
+#define NNUE_INPUTS 128
+#define NNUE_HIDDEN1 64
+#define NNUE_HIDDEN2 32
+// the clipped hidden values are in [0, NNUE_ONE]
+#define NNUE_ONE 127
+// weights of the second and third layers are int8s in 1/NNUE_WEIGHT_SCALE
+// (first layer weights are int16s in 1/NNUE_ONE)
+#define NNUE_WEIGHT_SCALE 64
+
+// bump when the network file format or the layers change
+#define NNUE_FILE_VERSION 1
+
+typedef struct {
+  alignas(32) int16_t values[NNUE_HIDDEN1];
+} nnue_accumulator_t;
+
+typedef struct {
+  // first layer, by input
+  alignas(32) int16_t input_weights[NNUE_INPUTS][NNUE_HIDDEN1];
+  alignas(32) int16_t input_bias[NNUE_HIDDEN1];
+  // second layer, by output
+  alignas(32) int8_t hidden_weights[NNUE_HIDDEN2][NNUE_HIDDEN1];
+  alignas(32) int32_t hidden_bias[NNUE_HIDDEN2];
+  alignas(32) int8_t output_weights[NNUE_HIDDEN2];
+  int32_t output_bias;
+  // not stored: the change of the first layer when a square is flipped to
+  // each player (set by nnue_prepare)
+  alignas(32) int16_t flip_weights[2][64][NNUE_HIDDEN1];
+} nnue_t;
+
+/* set the tables of net derived from its weights
+ * must be called after changing the weights, before net is used */
+void nnue_prepare(nnue_t *net);
+
+/* set acc to the first layer of net for board */
+void nnue_refresh(const nnue_t *net, board_t *board, nnue_accumulator_t *acc);
+
+/* update acc for player playing move, flipping flips (as board_do_move) */
+void nnue_do_move(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                  bitboard_t flips, color_t player);
+
+/* revert nnue_do_move (as board_undo_move) */
+void nnue_undo_move(const nnue_t *net, nnue_accumulator_t *acc, move_t move,
+                    bitboard_t flips, color_t player);
+
+/* the output of net for the board acc is the first layer of
+ * doesn't check for the end of the game, see evaluate_is_terminal */
+int32_t nnue_evaluate(const nnue_t *net, const nnue_accumulator_t *acc);
+
+/* use the kernels of variant (see cpu_select) */
+void nnue_select_kernels(cpu_variant_t variant);
+
+/**
+ * Load a network file
+ * The file holds a header (with NNUE_FILE_VERSION and the layer sizes) and the
+ * weights of each layer, little endian, in the order of nnue_t. Returns the
+ * network, or nullptr if the file couldn't be read or doesn't match this
+ * build. The network stays allocated until the program exits */
+const nnue_t *nnue_load(const char *path);
+
+/* checksum of the weights of net */
+uint32_t nnue_checksum(const nnue_t *net);
+
+/* write the weights of net to a network file
+ * returns false if the file couldn't be written */
+bool nnue_save(const char *path, const nnue_t *net);
@@ -0,0 +1,401 @@
+#include "pattern.hpp"
+#include "evaluator.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the most squares in a pattern
+#define PATTERN_MAX_SQUARES 10
+
+/* a pattern, and the places it appears on the board */
+typedef struct {
+  // the squares of the pattern, at the place it is read from
+  bitboard_t mask;
+  // the symmetries that move each place of the pattern onto mask (the pattern
+  // at symmetry s is read from bitboard_transform(board, s))
+  int num_places;
+  int symmetries[BOARD_SYMMETRIES];
+} pattern_class_t;
+
+/* each pattern appears once for every distinct place its mask is moved to
+ * by the symmetries: the symmetries that leave the mask where it is are left
+ * out, or the same squares would be counted twice */
+static const pattern_class_t pattern_classes[PATTERN_CLASSES] = {
+    // an edge, and the x squares next to its corners
+    {0x00000000000042ff, 4, {0, 1, 4, 5}},
+    // the 3x3 squares in a corner
+    {0x0000000000070707, 4, {0, 1, 2, 3}},
+    // the 2x5 squares in a corner, along an edge
+    {0x0000000000001f1f, 8, {0, 1, 2, 3, 4, 5, 6, 7}},
+    // the second, third and fourth line from an edge
+    {0x000000000000ff00, 4, {0, 1, 4, 5}},
+    {0x0000000000ff0000, 4, {0, 1, 4, 5}},
+    {0x00000000ff000000, 4, {0, 1, 4, 5}},
+    // the diagonals of 8 down to 4 squares
+    {0x8040201008040201, 2, {0, 2}},
+    {0x4020100804020100, 4, {0, 1, 2, 4}},
+    {0x2010080402010000, 4, {0, 1, 2, 4}},
+    {0x1008040201000000, 4, {0, 1, 2, 4}},
+    {0x0804020100000000, 4, {0, 1, 2, 4}},
+};
+
+/* the values of up to PATTERN_MAX_SQUARES binary digits read as base 3 */
+typedef struct {
+  uint16_t values[1 << PATTERN_MAX_SQUARES];
+} pattern_base3_t;
+
+static constexpr pattern_base3_t pattern_base3_table() {
+  pattern_base3_t table = {};
+  for (int bits = 0; bits < (1 << PATTERN_MAX_SQUARES); bits++) {
+    int value = 0;
+    for (int i = PATTERN_MAX_SQUARES - 1; i >= 0; i--)
+      value = value * 3 + ((bits >> i) & 1);
+    table.values[bits] = (uint16_t)value;
+  }
+  return table;
+}
+
+static constexpr pattern_base3_t pattern_base3 = pattern_base3_table();
+
+/* where each class's weights (and the mobility weights, at index
+ * PATTERN_CLASSES) start within a phase */
+typedef struct {
+  uint32_t offsets[PATTERN_CLASSES + 1];
+} pattern_offsets_t;
+
+static constexpr pattern_offsets_t pattern_offsets_table() {
+  pattern_offsets_t table = {};
+  uint32_t offset = 0;
+  for (int c = 0; c < PATTERN_CLASSES; c++) {
+    table.offsets[c] = offset;
+    uint32_t size = 1;
+    for (bitboard_t mask = pattern_classes[c].mask; mask; mask &= mask - 1)
+      size *= 3;
+    offset += size;
+  }
+  table.offsets[PATTERN_CLASSES] = offset;
+  return table;
+}
+
+static constexpr pattern_offsets_t pattern_offsets = pattern_offsets_table();
+
+static_assert(pattern_offsets.offsets[PATTERN_CLASSES] +
+                      2 * PATTERN_MAX_MOBILITY + 1 ==
+                  PATTERN_WEIGHTS,
+              "PATTERN_WEIGHTS doesn't match the pattern classes");
+
+/* the bits of x under mask, packed into the low bits
+ * bmi2 is a constant in each kernel variant, the instruction is only used
+ * where the cpu has it */
+CPU_KERNEL uint64_t pattern_pext(uint64_t x, uint64_t mask, bool bmi2) {
+#ifdef CPU_X86
+  if (bmi2) {
+    // inline asm rather than the intrinsic, which can't be inlined into
+    // functions compiled for the baseline
+    uint64_t packed;
+    asm("pext %2, %1, %0" : "=r"(packed) : "r"(x), "rm"(mask));
+    return packed;
+  }
+#endif
+  uint64_t packed = 0;
+  for (uint64_t bit = 1; mask; mask &= mask - 1, bit <<= 1) {
+    if (x & mask & -mask)
+      packed |= bit;
+  }
+  return packed;
+}
+
+/* a place a pattern appears, read straight from the board (rather than from
+ * the orientation that moves it onto its class's mask) */
+typedef struct {
+  // the squares of the place
+  bitboard_t mask;
+  // where the weights of its class start within a phase
+  uint32_t offset;
+  // the table of base 3 values of the bits packed from mask (see
+  // pattern_places_t)
+  int order;
+} pattern_place_t;
+
+typedef struct {
+  pattern_place_t places[PATTERN_FEATURES - 1];
+  // the squares of a place are packed in board order, and each is weighted by
+  // the digit it has when the pattern is read from its class's mask. Places
+  // packed in the same order share a table (most are packed in the order
+  // they're read, and use the first, which is pattern_base3)
+  int num_orders;
+  uint16_t orders[PATTERN_FEATURES][1 << PATTERN_MAX_SQUARES];
+} pattern_places_t;
+
+static pattern_places_t pattern_places_table() {
+  pattern_places_t table = {};
+  memcpy(table.orders[0], pattern_base3.values, sizeof(table.orders[0]));
+  table.num_orders = 1;
+  int n = 0;
+  for (int c = 0; c < PATTERN_CLASSES; c++) {
+    bitboard_t class_mask = pattern_classes[c].mask;
+    for (int i = 0; i < pattern_classes[c].num_places; i++) {
+      // the squares of the board that transforming it moves onto class_mask
+      int inverse = board_symmetry_inverse(pattern_classes[c].symmetries[i]);
+      pattern_place_t *place = &table.places[n++];
+      place->mask = bitboard_transform(class_mask, inverse);
+      place->offset = pattern_offsets.offsets[c];
+
+      // the value of each packed square (3 to the power of its digit)
+      int square_values[PATTERN_MAX_SQUARES];
+      int num_squares = 0;
+      int value = 1;
+      for (bitboard_t square_bits = class_mask; square_bits;
+           square_bits &= square_bits - 1, value *= 3, num_squares++) {
+        bitboard_t square =
+            bitboard_transform(square_bits & -square_bits, inverse);
+        square_values[bits_popcount(place->mask & (square - 1))] = value;
+      }
+      uint16_t *values = table.orders[table.num_orders];
+      for (int bits = 0; bits < (1 << num_squares); bits++) {
+        values[bits] = 0;
+        for (int j = 0; j < num_squares; j++) {
+          if ((bits >> j) & 1)
+            values[bits] += square_values[j];
+        }
+      }
+
+      size_t size = (1 << num_squares) * sizeof(uint16_t);
+      place->order = 0;
+      while (memcmp(values, table.orders[place->order], size) != 0)
+        place->order++;
+      if (place->order == table.num_orders)
+        table.num_orders++;
+    }
+  }
+  assert(n == PATTERN_FEATURES - 1);
+  return table;
+}
+
+static const pattern_places_t pattern_places = pattern_places_table();
+
+/* the index of the weight of place p on board, within the phase */
+CPU_KERNEL uint32_t pattern_index(board_t *board, int p, bool bmi2) {
+  const pattern_place_t *place = &pattern_places.places[p];
+  uint64_t squares0 = pattern_pext(board->players[0], place->mask, bmi2);
+  uint64_t squares1 = pattern_pext(board->players[1], place->mask, bmi2);
+  const uint16_t *values = pattern_places.orders[place->order];
+  return place->offset + values[squares0] + 2 * values[squares1];
+}
+
+/* the index of the mobility weight, within the phase */
+CPU_KERNEL uint32_t pattern_mobility_index(bitboard_t player0_moves,
+                                           bitboard_t player1_moves) {
+  int mobility = bits_popcount(player0_moves) - bits_popcount(player1_moves);
+  mobility = std::max(-PATTERN_MAX_MOBILITY,
+                      std::min(PATTERN_MAX_MOBILITY, mobility));
+  return pattern_offsets.offsets[PATTERN_CLASSES] + PATTERN_MAX_MOBILITY +
+         mobility;
+}
+
+CPU_KERNEL int pattern_board_phase(board_t *board) {
+  return pattern_phase(bits_popcount(board->players[0] | board->players[1]));
+}
+
+int pattern_features(board_t *board, bitboard_t player0_moves,
+                     bitboard_t player1_moves, uint32_t *dst) {
+  bool bmi2 = cpu_selected() != CPU_BASELINE;
+  for (int p = 0; p < PATTERN_FEATURES - 1; p++)
+    dst[p] = pattern_index(board, p, bmi2);
+  dst[PATTERN_FEATURES - 1] =
+      pattern_mobility_index(player0_moves, player1_moves);
+
+  return pattern_board_phase(board);
+}
+
+CPU_KERNEL int32_t pattern_evaluate_kernel(const int16_t *weights,
+                                           board_t *board,
+                                           bitboard_t player0_moves,
+                                           bitboard_t player1_moves,
+                                           bool bmi2) {
+  // the end of the game is scored like evaluate_board does
+  if (player0_moves == 0 && player1_moves == 0) {
+    return (bits_popcount(board->players[0]) -
+            bits_popcount(board->players[1])) *
+           EVAL_INF;
+  }
+
+  // the same features as pattern_features, summed as they are found
+  const int16_t *phase_weights =
+      weights + pattern_board_phase(board) * PATTERN_WEIGHTS;
+  int32_t value =
+      phase_weights[pattern_mobility_index(player0_moves, player1_moves)];
+  for (int p = 0; p < PATTERN_FEATURES - 1; p++)
+    value += phase_weights[pattern_index(board, p, bmi2)];
+  // the evaluation can't claim a board is won or lost, whatever the weights
+  return std::max(-(EVAL_INF - 1), std::min(EVAL_INF - 1, value));
+}
+
+void pattern_canonical_indices(uint32_t *dst) {
+  for (int c = 0; c < PATTERN_CLASSES; c++) {
+    bitboard_t mask = pattern_classes[c].mask;
+    uint32_t size = pattern_offsets.offsets[c + 1] - pattern_offsets.offsets[c];
+    // the symmetries that move the pattern onto itself
+    std::vector<int> symmetries;
+    for (int s = 1; s < BOARD_SYMMETRIES; s++) {
+      if (bitboard_transform(mask, s) == mask)
+        symmetries.push_back(s);
+    }
+
+    for (uint32_t index = 0; index < size; index++) {
+      // the squares of both players that give this index
+      bitboard_t players[2] = {0, 0};
+      bitboard_t square_bits = mask;
+      for (uint32_t digits = index; digits; digits /= 3) {
+        bitboard_t square = square_bits & -square_bits;
+        if (digits % 3 != 0)
+          players[digits % 3 - 1] |= square;
+        square_bits &= square_bits - 1;
+      }
+
+      uint32_t canonical = index;
+      for (int s : symmetries) {
+        uint64_t squares0 =
+            pattern_pext(bitboard_transform(players[0], s), mask, false);
+        uint64_t squares1 =
+            pattern_pext(bitboard_transform(players[1], s), mask, false);
+        canonical =
+            std::min(canonical, (uint32_t)pattern_base3.values[squares0] +
+                                    2 * pattern_base3.values[squares1]);
+      }
+      dst[pattern_offsets.offsets[c] + index] =
+          pattern_offsets.offsets[c] + canonical;
+    }
+  }
+
+  // the mobility difference reads the same in every orientation
+  for (uint32_t i = pattern_offsets.offsets[PATTERN_CLASSES];
+       i < PATTERN_WEIGHTS; i++) {
+    dst[i] = i;
+  }
+}
+
+/* --- kernel dispatch ---
+ * The features are mostly pext and table lookups, so the avx2 and avx-512
+ * variants use the bmi2 kernel */
+
+static int32_t pattern_evaluate_baseline(const int16_t *weights,
+                                         board_t *board,
+                                         bitboard_t player0_moves,
+                                         bitboard_t player1_moves) {
+  return pattern_evaluate_kernel(weights, board, player0_moves, player1_moves,
+                                 false);
+}
+
+#ifdef CPU_X86
+CPU_TARGET_POPCNT_BMI2 static int32_t
+pattern_evaluate_bmi2(const int16_t *weights, board_t *board,
+                      bitboard_t player0_moves, bitboard_t player1_moves) {
+  return pattern_evaluate_kernel(weights, board, player0_moves, player1_moves,
+                                 true);
+}
+
+static const pattern_evaluate_t pattern_evaluate_variants[CPU_VARIANTS] = {
+    pattern_evaluate_baseline, pattern_evaluate_bmi2, pattern_evaluate_bmi2,
+    pattern_evaluate_bmi2};
+#else
+static const pattern_evaluate_t pattern_evaluate_variants[CPU_VARIANTS] = {
+    pattern_evaluate_baseline, pattern_evaluate_baseline,
+    pattern_evaluate_baseline, pattern_evaluate_baseline};
+#endif
+
+pattern_evaluate_t pattern_kernel(cpu_variant_t variant) {
+  return pattern_evaluate_variants[variant];
+}
+
+/* --- weight files --- */
+
+/* start of a weight file, followed by phases * weights int16s */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t phases;
+  uint32_t weights;
+  uint32_t checksum;
+} pattern_file_header_t;
+
+static const char pattern_file_magic[8] = {'O', 'T', 'H', 'E',
+                                           'L', 'L', 'O', 'P'};
+
+#define PATTERN_FILE_WEIGHTS (PATTERN_PHASES * PATTERN_WEIGHTS)
+
+uint32_t pattern_checksum(const int16_t *weights) {
+  // fnv-1a over the weights
+  uint32_t checksum = 2166136261u;
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(weights);
+  for (size_t i = 0; i < PATTERN_FILE_WEIGHTS * sizeof(int16_t); i++)
+    checksum = (checksum ^ bytes[i]) * 16777619u;
+  return checksum;
+}
+
+/* the header a weight file of this build has */
+static pattern_file_header_t pattern_file_header(uint32_t checksum) {
+  pattern_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, pattern_file_magic, sizeof(header.magic));
+  header.version = PATTERN_FILE_VERSION;
+  header.phases = PATTERN_PHASES;
+  header.weights = PATTERN_WEIGHTS;
+  header.checksum = checksum;
+  return header;
+}
+
+const int16_t *pattern_load(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  size_t size =
+      sizeof(pattern_file_header_t) + PATTERN_FILE_WEIGHTS * sizeof(int16_t);
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+    close(fd);
+    return nullptr;
+  }
+  void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED)
+    return nullptr;
+
+  const pattern_file_header_t *header =
+      static_cast<const pattern_file_header_t *>(memory);
+  const int16_t *weights = reinterpret_cast<const int16_t *>(header + 1);
+  pattern_file_header_t expected = pattern_file_header(header->checksum);
+  if (memcmp(header, &expected, sizeof(expected)) != 0 ||
+      pattern_checksum(weights) != header->checksum) {
+    munmap(memory, size);
+    return nullptr;
+  }
+  return weights;
+}
+
+bool pattern_save(const char *path, const int16_t *weights) {
+  // written next to the file and renamed over it once complete, like table
+  // snapshots
+  std::string tmp_path = std::string(path) + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+
+  pattern_file_header_t header = pattern_file_header(pattern_checksum(weights));
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(weights, sizeof(int16_t), PATTERN_FILE_WEIGHTS, file) ==
+                PATTERN_FILE_WEIGHTS;
+  ok = fclose(file) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
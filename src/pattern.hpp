@@ -0,0 +1,84 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include "cpu.hpp"
+#include <cstdint>
+
+/**
+ * Pattern Evaluation
+ * The board is scored as the sum of weights looked up for the contents of a
+ * fixed set of square patterns (edges, corners, lines and diagonals). Each
+ * pattern has a weight for every combination of empty / player 0 / player 1 on
+ * its squares, indexed by reading the squares as a base 3 number. The same
+ * pattern appears in several places on the board (e.g. all four edges), which
+ * share one table: a pattern is always read from the orientation of the board
+ * that moves it to the place its mask describes (see bitboard_transform), so
+ * its squares are read in the same order everywhere. (The evaluation doesn't
+ * transform the board: each place is read where it is, with its squares
+ * weighted in that order.)
+ *
+ * The weights change over the course of the game, so there is a table for
+ * each phase (by number of pieces on the board). Weights are in
+ * 1/PATTERN_SCALE of a piece, from player 0's point of view.
+ */
+
+// number of phases with separate weights
+#define PATTERN_PHASES 12
+// weights are in 1/PATTERN_SCALE of a piece of final difference
+#define PATTERN_SCALE 128
+// number of pattern tables (each shared by all places the pattern appears)
+#define PATTERN_CLASSES 11
+// number of features of a board (pattern places, and the mobility feature)
+#define PATTERN_FEATURES 47
+// mobility differences beyond this are counted as this
+#define PATTERN_MAX_MOBILITY 32
+// number of weights in each phase
+#define PATTERN_WEIGHTS 167330
+
+// bump when the weight file format or the features change
+#define PATTERN_FILE_VERSION 1
+
+/* phase of a board with the given number of pieces */
+static inline int pattern_phase(int pieces) {
+  return (pieces - 4) * PATTERN_PHASES / 61;
+}
+
+/* the weight of each feature of board, as an index into a phase's weights
+ * writes PATTERN_FEATURES indices to dst, and returns the board's phase */
+int pattern_features(board_t *board, bitboard_t player0_moves,
+                     bitboard_t player1_moves, uint32_t *dst);
+
+/**
+ * Find the weights that should be equal
+ * A pattern can be moved onto itself by some symmetries (an edge by mirroring
+ * it), which read the same contents in a different order. For the evaluation
+ * to be the same in every orientation of a board, those readings need the same
+ * weight. Writes, for each of the PATTERN_WEIGHTS weights of a phase, the
+ * smallest index whose weight must be the same. */
+void pattern_canonical_indices(uint32_t *dst);
+
+/* evaluate a board with the given weights (PATTERN_PHASES * PATTERN_WEIGHTS of
+ * them, phase by phase)
+ * same result convention as evaluate_board: until the game is over the sum
+ * of the weights is clamped to within EVAL_INF - 1 */
+typedef int32_t (*pattern_evaluate_t)(const int16_t *weights, board_t *board,
+                                      bitboard_t player0_moves,
+                                      bitboard_t player1_moves);
+
+/* the pattern_evaluate kernel of variant (see cpu_select) */
+pattern_evaluate_t pattern_kernel(cpu_variant_t variant);
+
+/**
+ * Map a weight file read only
+ * The file holds a header (with PATTERN_FILE_VERSION and the number of weights)
+ * and the weights as little endian int16s. Returns the weights, or nullptr if
+ * the file couldn't be read or doesn't match this build. The mapping stays
+ * until the program exits */
+const int16_t *pattern_load(const char *path);
+
+/* checksum of weights (PATTERN_PHASES * PATTERN_WEIGHTS of them) */
+uint32_t pattern_checksum(const int16_t *weights);
+
+/* write weights (PATTERN_PHASES * PATTERN_WEIGHTS of them) to a weight file
+ * returns false if the file couldn't be written */
+bool pattern_save(const char *path, const int16_t *weights);
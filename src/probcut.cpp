@@ -0,0 +1,45 @@
+#include "probcut.hpp"
+#include "probcut_params.hpp"
+#include <algorithm>
+
+/* confidence of each selectivity level, in deviations (level 0 is off) */
+static const double probcut_thresholds[PROBCUT_LEVELS] = {0.0, 2.0, 1.5, 1.1,
+                                                         0.7};
+
+int probcut_phase(int empties) {
+  if (empties > 44)
+    return 0;
+  if (empties > 20)
+    return 1;
+  return 2;
+}
+
+int probcut_shallow_depth(int depth, int check) {
+  if (depth < PROBCUT_MIN_DEPTH || depth > PROBCUT_MAX_DEPTH)
+    return 0;
+  // about a quarter of the depth, then about halfway between that and depth
+  int shallow = depth / 4;
+  if ((shallow ^ depth) & 1)
+    shallow++;
+  if (check == 0)
+    return shallow;
+  int deeper = shallow + 2 * ((depth - shallow) / 4);
+  if (check == 1 && deeper != shallow)
+    return deeper;
+  return 0;
+}
+
+const probcut_param_t *probcut_params(int phase, int depth, int check) {
+  if (probcut_shallow_depth(depth, check) == 0)
+    return nullptr;
+  const probcut_param_t *param =
+      &probcut_param_table[phase][std::min(depth, PROBCUT_CALIBRATED_DEPTH)]
+                          [check];
+  if (param->sigma <= 0.0f || param->a <= 0.0f)
+    return nullptr;
+  return param;
+}
+
+double probcut_threshold(int level) {
+  return probcut_thresholds[std::clamp(level, 0, PROBCUT_LEVELS - 1)];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Multi-ProbCut
+ * The result of a deep search is well predicted by the result of a shallow
+ * search of the same position: deep ~= a * shallow + b, with a roughly normal
+ * error of deviation sigma. Before searching a node to depth d, a null window
+ * search to a much smaller depth checks whether the deep search is likely
+ * (with a confidence set by the selectivity level) to fail high or low, and
+ * the node is cut if it is. Several shallow depths are tried per node, cheapest
+ * first, with parameters fitted separately for each game phase.
+ *
+ * The parameters are fitted to the evaluator by the othello_mpc_calibrate tool,
+ * which writes probcut_params.hpp. They have to be refitted whenever
+ * evaluate_board changes.
+ */
+
+// game phases with separate parameters and selectivity (opening, midgame,
+// endgame), split at the same number of empties as the time allocation
+#define PROBCUT_PHASES 3
+// selectivity levels: 0 disables probcut, higher levels cut more aggressively
+#define PROBCUT_LEVELS 5
+// shallowest depth probcut is tried at
+#define PROBCUT_MIN_DEPTH 3
+// deepest depth the parameter table has room for
+#define PROBCUT_MAX_DEPTH 32
+// shallow searches tried per node
+#define PROBCUT_CHECKS 2
+
+/* fitted parameters of one (phase, deep depth, shallow depth) triple
+ * sigma is 0 if the pair wasn't calibrated */
+typedef struct {
+  float a;
+  float b;
+  float sigma;
+} probcut_param_t;
+
+/* phase of a position with the given number of empty squares */
+int probcut_phase(int empties);
+
+/* depth of the given shallow search used for a search of depth, 0 if none
+ * the shallow depth has the same parity as depth, as the evaluation depends on
+ * who is to move at the leaves */
+int probcut_shallow_depth(int depth, int check);
+
+/**
+ * Parameters for a check of a search of depth in phase, nullptr if the check
+ * isn't available
+ * Depths past the deepest calibrated one reuse its parameters */
+const probcut_param_t *probcut_params(int phase, int depth, int check);
+
+/* number of deviations a prediction must clear the window by at a level */
+double probcut_threshold(int level);
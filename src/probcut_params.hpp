@@ -0,0 +1,59 @@
+#pragma once
+
+#include "probcut.hpp"
+
+/* multi-probcut parameters (a, b, sigma), indexed as
+ * [phase][deep depth][check]
+ * generated by othello_mpc_calibrate from 1000 positions */
+
+#define PROBCUT_CALIBRATED_DEPTH 12
+
+static const probcut_param_t
+    probcut_param_table[PROBCUT_PHASES][PROBCUT_CALIBRATED_DEPTH + 1]
+                       [PROBCUT_CHECKS] = {
+        {
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.9155f, -0.2398f, 6.7499f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.9423f, -1.3957f, 6.8974f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.9404f, -1.4168f, 8.3276f}, {1.0215f, -1.1119f, 4.9167f}},
+            {{1.0123f, -1.0151f, 8.1130f}, {1.0604f, 0.5119f, 4.3442f}},
+            {{0.9937f, -2.2910f, 9.7596f}, {1.0988f, -2.1698f, 5.8531f}},
+            {{1.0459f, -1.2144f, 9.3388f}, {1.1145f, 0.3254f, 5.0841f}},
+            {{1.1502f, -3.2703f, 6.9436f}, {1.1188f, -1.9496f, 4.7101f}},
+            {{1.0855f, -0.6690f, 10.0938f}, {1.0872f, 0.3803f, 3.9859f}},
+            {{1.1744f, -3.8485f, 7.8413f}, {1.0809f, -1.6415f, 3.6857f}},
+            {{1.2088f, 1.5355f, 6.6837f}, {1.0887f, 1.1721f, 3.3254f}},
+        },
+        {
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0651f, -2.5954f, 9.8493f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0532f, 0.8155f, 8.9602f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0939f, -4.0168f, 13.9402f}, {1.0372f, -1.4896f, 7.4908f}},
+            {{1.0940f, 1.3952f, 12.4662f}, {1.0458f, 0.4885f, 6.5087f}},
+            {{1.1392f, -5.1981f, 16.9647f}, {1.0866f, -2.6547f, 10.6699f}},
+            {{1.1354f, 1.9988f, 15.2067f}, {1.0902f, 1.0170f, 9.5214f}},
+            {{1.1268f, -3.6687f, 13.5841f}, {1.0962f, -2.1769f, 8.7759f}},
+            {{1.1737f, 2.5607f, 17.9192f}, {1.0897f, 0.9065f, 8.3095f}},
+            {{1.1645f, -4.1536f, 16.1703f}, {1.0860f, -1.4835f, 8.0365f}},
+            {{1.1703f, 2.0895f, 14.5438f}, {1.0833f, 0.8971f, 7.7356f}},
+        },
+        {
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{0.0000f, 0.0000f, 0.0000f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0464f, -4.0296f, 11.8737f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0532f, 2.0008f, 11.2718f}, {0.0000f, 0.0000f, 0.0000f}},
+            {{1.0792f, -5.7842f, 17.9099f}, {1.0416f, -1.7625f, 9.8735f}},
+            {{1.1023f, 3.7591f, 16.7564f}, {1.0543f, 1.5908f, 9.0678f}},
+            {{1.1254f, -6.9834f, 23.5144f}, {1.0920f, -2.8667f, 16.3080f}},
+            {{1.1620f, 5.6500f, 22.3793f}, {1.1179f, 3.3012f, 15.0506f}},
+            {{1.1590f, -3.6860f, 21.2910f}, {1.1273f, -1.8995f, 14.3648f}},
+            {{1.2160f, 6.5349f, 26.4279f}, {1.1223f, 2.1628f, 13.3764f}},
+            {{1.2051f, -4.6793f, 25.3957f}, {1.1195f, -1.6081f, 13.4693f}},
+            {{1.2075f, 5.3256f, 24.2026f}, {1.1031f, 1.8554f, 13.9442f}},
+        },
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "hash_table.hpp"
+#include "minimax.hpp"
+#include "move_order.hpp"
+#include "nnue.hpp"
+#include "split.hpp"
+#include "stats.hpp"
+#include "time_control.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+// the main search thread checks the clock every check_interval boards, and
+// adapts the interval so that checks happen about this often (ms)
+#define TIME_CHECK_TARGET_MS 2
+#define TIME_CHECK_MIN_BOARDS 256
+#define TIME_CHECK_MAX_BOARDS 1048576
+
+// with symmetric keys, boards with at most this many pieces (about the first
+// 20 plies) are keyed on their canonical orientation; mirror images of later
+// boards hardly ever meet, so they aren't worth canonicalizing
+#define SEARCH_SYMMETRY_MAX_PIECES 24
+
+/**
+ * State of one search thread
+ * With more than one thread, every thread runs its own iterative deepening
+ * against the shared transposition table (lazy smp). The helpers start at
+ * staggered depths and break move ordering ties differently, so they fill the
+ * table with results thread 0 hasn't reached yet. Only thread 0's result is
+ * used. */
+typedef struct {
+  int id;
+  const search_config_t *config;
+  hash_table_t hash_table;
+  // set once thread 0 has finished its search (or pondering is stopped)
+  std::atomic<bool> *stop;
+  // pondering threads have no time limit, and only stop when asked
+  bool ponder;
+  // set once the thread has noticed it should stop; every search function
+  // returns as soon as it sees this, without storing anything
+  bool aborted;
+  // boards visited since the last time check, and boards between checks
+  int board_i;
+  int check_interval;
+  search_clock_t::time_point last_check;
+  search_clock_t::time_point last_print;
+  // nullptr if the search has no time limit
+  const search_deadline_t *deadline;
+  // deepest iteration to run, 0 for no limit
+  int max_depth;
+  // player to move at the root
+  color_t root_player;
+  // depth of the current iteration (the ply of a node is root_depth - depth)
+  int root_depth;
+  move_order_t order;
+  // the network boards are evaluated with (see evaluator_nnue), nullptr if
+  // none, and its first layer for the thread's board, updated along with it
+  const nnue_t *nnue;
+  nnue_accumulator_t accumulator;
+  // work stealing pool of the endgame solver, nullptr if the solver doesn't
+  // split (single thread, or the root isn't within the solver's reach)
+  split_pool_t *pool;
+  // split point of the task the thread is searching, nullptr if none
+  split_point_t *split;
+  search_stats_t stats;
+} search_thread_t;
+
+/* whether board is keyed on its canonical orientation in the table */
+static inline bool search_symmetric_key(const search_thread_t *thread,
+                                        board_t *board) {
+  return thread->config->symmetry &&
+         bits_popcount(board->players[0] | board->players[1]) <=
+             SEARCH_SYMMETRY_MAX_PIECES;
+}
+
+/* the key board (with player to move, hashing to hash) is stored under in the
+ * table
+ * With a symmetric key, that's the hash of the board's canonical orientation,
+ * and symmetry is set to the transform from board to it (the best move of the
+ * entry is stored in the canonical orientation). Otherwise, it's hash itself,
+ * with the identity transform */
+static inline uint64_t search_table_key(const search_thread_t *thread,
+                                        board_t *board, uint64_t hash,
+                                        color_t player, int *symmetry) {
+  *symmetry = 0;
+  if (!search_symmetric_key(thread, board))
+    return hash;
+  board_t canonical;
+  *symmetry = board_canonical(board, &canonical);
+  return *symmetry == 0 ? hash : hash_board(&canonical, player);
+}
+
+/* look up the entry stored under key (from search_table_key), with its best
+ * move transformed back from the canonical orientation */
+static inline bool search_table_lookup(const search_thread_t *thread,
+                                       uint64_t key, int symmetry,
+                                       hash_entry_t *dst) {
+  if (!hash_table_lookup(thread->hash_table, key, dst))
+    return false;
+  if (symmetry != 0 && dst->best_move < 64)
+    dst->best_move =
+        move_transform(dst->best_move, board_symmetry_inverse(symmetry));
+  return true;
+}
+
+/* called at every node: returns true (and sets aborted) if the thread should
+ * stop */
+static inline bool search_thread_poll(search_thread_t *thread) {
+  if (thread->stop->load(std::memory_order_relaxed) ||
+      split_is_cut(thread->split)) {
+    thread->aborted = true;
+    return true;
+  }
+  if (thread->id != 0 || thread->deadline == nullptr ||
+      ++thread->board_i < thread->check_interval) {
+    return false;
+  }
+
+  thread->board_i = 0;
+  auto now = search_clock_t::now();
+  // keep the time between checks near TIME_CHECK_TARGET_MS
+  auto since_check = now - thread->last_check;
+  thread->last_check = now;
+  if (since_check < std::chrono::milliseconds(TIME_CHECK_TARGET_MS) / 2) {
+    thread->check_interval =
+        std::min(thread->check_interval * 2, TIME_CHECK_MAX_BOARDS);
+  } else if (since_check > std::chrono::milliseconds(TIME_CHECK_TARGET_MS) * 2) {
+    thread->check_interval =
+        std::max(thread->check_interval / 2, TIME_CHECK_MIN_BOARDS);
+  }
+
+  if (now >= thread->deadline->hard_deadline) {
+    // only thread 0 checks the clock, so the other threads are stopped too
+    thread->stop->store(true, std::memory_order_relaxed);
+    thread->aborted = true;
+    return true;
+  }
+  if (now - thread->last_print >= std::chrono::seconds(1)) {
+    thread->last_print = now;
+    printf("Searching... %.1lf s    \r",
+           std::chrono::duration<double>(thread->deadline->hard_deadline - now)
+               .count());
+    fflush(stdout);
+  }
+  return false;
+}
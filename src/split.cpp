@@ -0,0 +1,43 @@
+#include "split.hpp"
+
+void split_push(split_pool_t *pool, int id, split_task_t task) {
+  split_deque_t *deque = &pool->deques[id];
+  std::lock_guard<std::mutex> guard(deque->lock);
+  deque->tasks.push_back(task);
+  pool->queued.fetch_add(1, std::memory_order_release);
+}
+
+/* take a task from the back (newest) or front (oldest) of a deque */
+static bool split_take(split_pool_t *pool, split_deque_t *deque,
+                       split_task_t *dst, bool newest) {
+  std::lock_guard<std::mutex> guard(deque->lock);
+  if (deque->tasks.empty())
+    return false;
+  if (newest) {
+    *dst = deque->tasks.back();
+    deque->tasks.pop_back();
+  } else {
+    *dst = deque->tasks.front();
+    deque->tasks.pop_front();
+  }
+  pool->queued.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool split_pop(split_pool_t *pool, int id, split_task_t *dst) {
+  if (pool->queued.load(std::memory_order_acquire) == 0)
+    return false;
+  return split_take(pool, &pool->deques[id], dst, true);
+}
+
+bool split_steal(split_pool_t *pool, int id, split_task_t *dst) {
+  if (pool->queued.load(std::memory_order_acquire) == 0)
+    return false;
+  // start with the next thread, so thieves spread over the victims
+  for (int i = 1; i < pool->num_deques; i++) {
+    int victim = (id + i) % pool->num_deques;
+    if (split_take(pool, &pool->deques[victim], dst, false))
+      return true;
+  }
+  return false;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+/**
+ * Split points and the work stealing pool (young brothers wait)
+ * A node is only split after its eldest child has been searched (so the window
+ * is usually final). The younger siblings are pushed as tasks onto the
+ * splitting thread's deque. The owner takes tasks from the back of its deque
+ * (depth first), idle threads steal from the front of other threads' deques
+ * (the oldest, and usually largest, tasks). When a sibling fails high, the
+ * split point is marked cut, and every task under it (at any depth of nested
+ * split points) stops as soon as it notices.
+ */
+
+typedef struct split_point_s split_point_t;
+struct split_point_s {
+  // split point of the task the node was searched in (nullptr if none)
+  split_point_t *parent;
+  color_t player;
+  // children (with player's move made), their hashes (only filled in if the
+  // children use the table), and the moves leading to them
+  const board_t *children;
+  const uint64_t *hashes;
+  const move_t *moves;
+  int beta;
+  // raised as siblings finish, so later siblings search with a narrower window
+  std::atomic<int> alpha;
+  // set once a sibling fails high (or the node's own search is cut)
+  std::atomic<bool> cut;
+  // set if a sibling was stopped before it finished for any other reason than
+  // the cut (the node's result is then incomplete)
+  std::atomic<bool> aborted;
+  // tasks pushed that haven't finished yet
+  std::atomic<int> pending;
+  // protects best and best_move
+  std::mutex lock;
+  int best;
+  move_t best_move;
+};
+
+/* search children[index] of a split point */
+typedef struct {
+  split_point_t *split;
+  int index;
+} split_task_t;
+
+typedef struct {
+  std::mutex lock;
+  std::deque<split_task_t> tasks;
+} split_deque_t;
+
+/* one deque per search thread, indexed by thread id */
+typedef struct {
+  int num_deques;
+  split_deque_t *deques;
+  // tasks in all deques, so idle threads don't take locks to find nothing
+  std::atomic<int> queued;
+} split_pool_t;
+
+/* push a task onto the back of thread id's deque */
+void split_push(split_pool_t *pool, int id, split_task_t task);
+
+/* take the newest task from thread id's own deque, false if it is empty */
+bool split_pop(split_pool_t *pool, int id, split_task_t *dst);
+
+/* take the oldest task from another thread's deque, false if there is none */
+bool split_steal(split_pool_t *pool, int id, split_task_t *dst);
+
+/* true if split (or any split point above it) has been cut */
+static inline bool split_is_cut(const split_point_t *split) {
+  for (; split != nullptr; split = split->parent) {
+    if (split->cut.load(std::memory_order_acquire))
+      return true;
+  }
+  return false;
+}
@@ -1,22 +1,36 @@
 #include "stats.hpp"
 #include "hash_table.hpp"
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 
-int64_t boards_visited;
-int64_t boards_direct_table_hits;
-int64_t boards_bounds_table_hits;
-int64_t boards_best_move_hits;
-int64_t table_set_entries;
-int64_t minimax_depth;
+void stats_reset(search_stats_t *stats) {
+  memset(stats, 0, sizeof(search_stats_t));
+}
 
-void stats_reset() {
+void stats_merge(search_stats_t *dst, const search_stats_t *src) {
 #ifdef COUNT_STATS
-  boards_visited = 0;
-  boards_direct_table_hits = 0;
-  boards_bounds_table_hits = 0;
-  boards_best_move_hits = 0;
-  minimax_depth = 0;
-  // don't reset table_set_entries, as table entries last between turns
+  dst->boards_visited += src->boards_visited;
+  dst->table_probes += src->table_probes;
+  dst->table_hits += src->table_hits;
+  dst->boards_direct_table_hits += src->boards_direct_table_hits;
+  dst->boards_bounds_table_hits += src->boards_bounds_table_hits;
+  dst->boards_best_move_hits += src->boards_best_move_hits;
+  dst->etc_cutoffs += src->etc_cutoffs;
+  dst->stability_cutoffs += src->stability_cutoffs;
+  dst->beta_cutoffs += src->beta_cutoffs;
+  dst->first_move_cutoffs += src->first_move_cutoffs;
+  dst->pvs_researches += src->pvs_researches;
+  dst->aspiration_researches += src->aspiration_researches;
+  dst->probcut_probes += src->probcut_probes;
+  dst->probcut_cuts += src->probcut_cuts;
+  dst->endgame_solves += src->endgame_solves;
+  dst->endgame_boards += src->endgame_boards;
+  dst->endgame_splits += src->endgame_splits;
+  dst->endgame_steals += src->endgame_steals;
+  dst->minimax_depth = std::max(dst->minimax_depth, src->minimax_depth);
+  dst->search_threads += src->search_threads;
+  dst->search_time_ms = std::max(dst->search_time_ms, src->search_time_ms);
 #endif
 }
 
@@ -31,21 +45,55 @@ void pprint_num(double num) {
   }
 }
 
-void stats_print(double search_time) {
+void stats_print(const search_stats_t *stats, hash_table_t hash_table) {
 #ifdef COUNT_STATS
-  printf("Depth Visited:        %li\n", minimax_depth);
+  auto threads = std::max<int64_t>(stats->search_threads, 1);
+  double search_time = std::max<int64_t>(stats->search_time_ms, 1) / 1000.0;
+  printf("Search Time:          %.3lf s\n", search_time);
+  printf("Depth Visited:        %li\n", stats->minimax_depth);
   printf("Boards Visited:       ");
-  pprint_num((double)boards_visited);
+  pprint_num((double)stats->boards_visited);
   printf("\nBoards/Second:        ");
-  pprint_num(((double)boards_visited) / search_time);
-  printf("/s\nTransposition Table:\n");
+  pprint_num(((double)stats->boards_visited) / search_time);
+  printf("/s\nThreads:              %li (", threads);
+  pprint_num(((double)stats->boards_visited) / search_time / threads);
+  printf("/s per thread)\nTransposition Table:\n");
   printf("  Load Factor:        %.2lf %%\n",
-         ((double)table_set_entries) / ((double)HASH_TABLE_SIZE) * 100.0);
+         hash_table_load_factor(hash_table) * 100.0);
+  printf("  Hit Rate:           %.2lf %%\n",
+         ((double)stats->table_hits) / ((double)stats->table_probes) * 100.0);
   printf("  Exact Board Hits:   %.2lf %%\n",
-         ((double)boards_direct_table_hits) / ((double)boards_visited) * 100.0);
+         ((double)stats->boards_direct_table_hits) /
+             ((double)stats->boards_visited) * 100.0);
   printf("  Bounds Hits:        %.2lf %%\n",
-         ((double)boards_bounds_table_hits) / ((double)boards_visited) * 100.0);
+         ((double)stats->boards_bounds_table_hits) /
+             ((double)stats->boards_visited) * 100.0);
   printf("  Best Move Hits:     %.2lf %%\n",
-         ((double)boards_best_move_hits) / ((double)boards_visited) * 100.0);
+         ((double)stats->boards_best_move_hits) /
+             ((double)stats->boards_visited) * 100.0);
+  printf("  ETC Cutoffs:        %.2lf %%\n",
+         ((double)stats->etc_cutoffs) / ((double)stats->boards_visited) *
+             100.0);
+  printf("  Stability Cutoffs:  %.2lf %%\n",
+         ((double)stats->stability_cutoffs) /
+             ((double)stats->boards_visited) * 100.0);
+  printf("Move Ordering:\n");
+  printf("  First Move Cutoffs: %.2lf %%\n",
+         ((double)stats->first_move_cutoffs) /
+             ((double)stats->beta_cutoffs) * 100.0);
+  printf("Multi-ProbCut:\n");
+  printf("  Probes:             ");
+  pprint_num((double)stats->probcut_probes);
+  printf("\n  Cuts:               ");
+  pprint_num((double)stats->probcut_cuts);
+  printf("\nEndgame Solver:\n");
+  printf("  Solves:             %li\n", stats->endgame_solves);
+  printf("  Boards Visited:     ");
+  pprint_num((double)stats->endgame_boards);
+  printf("\n  Splits:             %li (%li stolen)\n", stats->endgame_splits,
+         stats->endgame_steals);
+  printf("Re-searches:\n");
+  printf("  PVS:                %li\n", stats->pvs_researches);
+  printf("  Aspiration:         %li\n", stats->aspiration_researches);
 #endif
-}
\ No newline at end of file
+}
@@ -1,23 +1,67 @@
 #pragma once
 
+#include "hash_table.hpp"
 #include <cstdint>
 
 #define COUNT_STATS
 
-// number of total boards visited by minimax
-extern int64_t boards_visited;
-// number of boards visited by minimax that used transposition table directly
-// for value
-extern int64_t boards_direct_table_hits;
-// number of boards visited that used bounds from table
-extern int64_t boards_bounds_table_hits;
-// number of boards visited that used previous best move calculations
-extern int64_t boards_best_move_hits;
+/**
+ * Search statistics
+ * Each search thread counts into its own copy, and the copies are merged once
+ * the search is finished (so that threads don't share counter cache lines) */
+typedef struct {
+  // number of total boards visited by minimax
+  int64_t boards_visited;
+  // number of transposition table lookups for the boards visited, and how many
+  // of them found the board
+  int64_t table_probes;
+  int64_t table_hits;
+  // number of boards visited by minimax that used transposition table directly
+  // for value
+  int64_t boards_direct_table_hits;
+  // number of boards visited that used bounds from table
+  int64_t boards_bounds_table_hits;
+  // number of boards cut by a child's table entry (enhanced transposition
+  // cutoff)
+  int64_t etc_cutoffs;
+  // number of boards cut because the opponent's stable pieces cap the score
+  int64_t stability_cutoffs;
+  // number of boards visited that used previous best move calculations
+  int64_t boards_best_move_hits;
+  // number of nodes that ended in a beta cutoff
+  int64_t beta_cutoffs;
+  // number of beta cutoffs caused by the first move searched
+  int64_t first_move_cutoffs;
+  // number of null window searches that failed high and had to be re-searched
+  int64_t pvs_researches;
+  // number of root searches that fell outside the aspiration window
+  int64_t aspiration_researches;
+  // number of shallow multi-probcut searches
+  int64_t probcut_probes;
+  // number of nodes cut by multi-probcut
+  int64_t probcut_cuts;
+  // number of boards handed to the endgame solver
+  int64_t endgame_solves;
+  // number of boards visited by the endgame solver (included in boards_visited)
+  int64_t endgame_boards;
+  // number of endgame nodes whose younger siblings were searched in parallel
+  int64_t endgame_splits;
+  // number of sibling searches taken from another thread's deque
+  int64_t endgame_steals;
+  // depth to which minimax went
+  int64_t minimax_depth;
+  // number of threads that took part in the search
+  int64_t search_threads;
+  // wall clock time the search took
+  int64_t search_time_ms;
+} search_stats_t;
 
-// number of set entries in the transposition table
-extern int64_t table_set_entries;
-// depth to which minimax went
-extern int64_t minimax_depth;
+void stats_reset(search_stats_t *stats);
 
-void stats_reset();
-void stats_print(double search_time);
\ No newline at end of file
+/* add the counters in src into dst (depth is the max of the two) */
+void stats_merge(search_stats_t *dst, const search_stats_t *src);
+
+/* print a number with a unit prefix (k / M) */
+void pprint_num(double num);
+
+void stats_print(const search_stats_t *stats, hash_table_t hash_table);
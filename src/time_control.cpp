@@ -0,0 +1,66 @@
+#include "time_control.hpp"
+#include <algorithm>
+
+// the move time is never allocated below this (ms)
+#define TIME_MIN_MS 10
+// with a game budget, a single move may use at most this many times its share
+#define TIME_HARD_FACTOR 2.5
+// and never more than this fraction of the time left in the game
+#define TIME_MAX_REMAINING_FRACTION 0.3
+
+/* share of a move's time given to a position with the given number of empty
+ * squares: the opening is mostly decided by the first few plies of search,
+ * while midgame moves profit the most from a deeper search */
+static double time_control_phase_factor(int empties) {
+  if (empties > 44)
+    return 0.6;
+  if (empties > 20)
+    return 1.3;
+  return 1.0;
+}
+
+void time_control_init(time_control_t *control, double move_time,
+                       double game_time) {
+  control->move_time_ms = (int64_t)(move_time * 1000.0);
+  control->game_time_ms = (int64_t)(game_time * 1000.0);
+  control->game_time_used_ms = 0;
+}
+
+void time_control_new_game(time_control_t *control) {
+  control->game_time_used_ms = 0;
+}
+
+void time_control_allocate(time_control_t *control, board_t *board,
+                           search_deadline_t *dst) {
+  int empties = 64 - bits_popcount(board->players[0] | board->players[1]);
+  double factor = time_control_phase_factor(empties);
+
+  int64_t target, hard;
+  if (control->game_time_ms > 0) {
+    // we make about every other move of the rest of the game
+    int64_t moves_left = std::max(empties / 2, 1);
+    int64_t remaining = std::max<int64_t>(
+        control->game_time_ms - control->game_time_used_ms, 0);
+    target = (int64_t)((double)(remaining / moves_left) * factor);
+    hard = std::min((int64_t)(target * TIME_HARD_FACTOR),
+                    (int64_t)(remaining * TIME_MAX_REMAINING_FRACTION));
+    if (control->move_time_ms > 0)
+      hard = std::min(hard, control->move_time_ms);
+  } else {
+    // every move has a limit of its own, and time the opening saves can't be
+    // carried over, so the midgame can't be given more than the others: the
+    // factor only shortens the opening
+    hard = control->move_time_ms;
+    target = (int64_t)((double)control->move_time_ms * std::min(factor, 1.0));
+  }
+  hard = std::max<int64_t>(hard, TIME_MIN_MS);
+  target = std::clamp<int64_t>(target, TIME_MIN_MS, hard);
+
+  dst->start = search_clock_t::now();
+  dst->hard_deadline = dst->start + std::chrono::milliseconds(hard);
+  dst->target_ms = target;
+}
+
+void time_control_used(time_control_t *control, int64_t used_ms) {
+  control->game_time_used_ms += used_ms;
+}
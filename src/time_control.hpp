@@ -0,0 +1,57 @@
+#pragma once
+
+#include "bitboard.hpp"
+#include <chrono>
+
+typedef std::chrono::steady_clock search_clock_t;
+
+/**
+ * Time limits for one search
+ * The search is aborted as soon as the hard deadline passes. No new iteration
+ * of the iterative deepening is started once half of the target time is used
+ * (the next iteration usually takes longer than all the previous ones), or
+ * once a quarter is used if the best move has been stable for a few
+ * iterations. */
+typedef struct {
+  search_clock_t::time_point start;
+  search_clock_t::time_point hard_deadline;
+  // time the search aims to use (ms)
+  int64_t target_ms;
+} search_deadline_t;
+
+/**
+ * Time allocation over a game
+ * Without a game budget, every move may use up to move_time, but the opening
+ * is given less than that (the weighting towards the midgame needs a budget to
+ * take the time from). With a game budget, the remaining time is split
+ * over the remaining moves, weighted towards the midgame, and time left over by
+ * moves that stopped early carries over to later moves. */
+typedef struct {
+  // maximum time for one move (ms)
+  int64_t move_time_ms;
+  // time for the whole game (ms), 0 if there is no game budget
+  int64_t game_time_ms;
+  // time used so far in this game (ms)
+  int64_t game_time_used_ms;
+} time_control_t;
+
+/* set up the time control for a new game */
+void time_control_init(time_control_t *control, double move_time,
+                       double game_time);
+
+/* start of a new game (with the same budgets) */
+void time_control_new_game(time_control_t *control);
+
+/* compute the deadlines for a search on board, starting now */
+void time_control_allocate(time_control_t *control, board_t *board,
+                           search_deadline_t *dst);
+
+/* record the time taken by a move */
+void time_control_used(time_control_t *control, int64_t used_ms);
+
+/* milliseconds since the search started */
+static inline int64_t search_deadline_elapsed_ms(const search_deadline_t *d) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             search_clock_t::now() - d->start)
+      .count();
+}
@@ -0,0 +1,700 @@
+#include "bitboard.hpp"
+#include "evaluator.hpp"
+#include "hash_table.hpp"
+#include "minimax.hpp"
+#include "nnue.hpp"
+#include "pattern.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Pattern weight training
+ * play: plays GAMES games of the engine against itself, searching DEPTH plies
+ * deep and solving the last ENDGAME_EMPTIES empty squares exactly, and appends
+ * every position of every game to FILE, one position per line:
+ *   player0 player1 score
+ * (the bitboards in hex, and the final disc difference for player 0). The
+ * positions of a game are written together, in the order they were played;
+ * the fits rely on that to tell the games apart.
+ * fit: fits the pattern weights of each phase to the samples in FILE by least
+ * squares, and writes them to OUTPUT as a weight file (see pattern_load)
+ * fit-nnue: trains a network (see nnue.hpp) on the samples in FILE for EPOCHS
+ * passes of stochastic gradient descent, and writes it to OUTPUT as a network
+ * file (see nnue_load)
+ * All of them use every core. */
+
+#define TRAIN_DEFAULT_DEPTH 4
+#define TRAIN_DEFAULT_EMPTIES 14
+#define TRAIN_DEFAULT_ITERATIONS 100
+// the first moves of each game are played at random, so the games differ
+#define TRAIN_RANDOM_PLIES 10
+#define TRAIN_HASH_MB 16
+// the samples of every TRAIN_VALIDATION-th game are left out of the fit, to
+// measure the error on games the weights weren't fitted to (all positions of a
+// game share its score, so leaving out single positions wouldn't)
+#define TRAIN_VALIDATION 16
+/* weights are pulled towards the previous phase's weights as much as by this
+ * many samples agreeing with them, which keeps the rarely seen ones in check */
+#define TRAIN_RIDGE 4.0
+
+#define TRAIN_DEFAULT_EPOCHS 20
+// learning rate of the first epoch, and the factor it shrinks by after each
+#define TRAIN_NNUE_RATE 0.01f
+#define TRAIN_NNUE_RATE_DECAY 0.85f
+// bound on first layer weights and biases, which keeps the sum of 64 pieces'
+// weights and the bias within the int16 accumulator
+#define TRAIN_NNUE_MAX_INPUT_WEIGHT 2.0f
+// bound on the other weights, the most an int8 holds
+#define TRAIN_NNUE_MAX_WEIGHT (127.0f / NNUE_WEIGHT_SCALE)
+
+typedef struct {
+  board_t board;
+  int32_t score;
+  // index of the game in the file
+  int game;
+} train_sample_t;
+
+typedef struct {
+  FILE *out;
+  int games;
+  int depth;
+  int endgame_empties;
+  unsigned seed;
+  std::atomic<int> next_game;
+  // guards out and games_done
+  std::mutex lock;
+  int games_done;
+  long positions_done;
+} train_play_t;
+
+void print_usage(const char *name) {
+  printf("Usage: %s play FILE GAMES [DEPTH [ENDGAME_EMPTIES [SEED "
+         "[EVAL_WEIGHTS]]]]\n"
+         "       %s fit FILE OUTPUT [ITERATIONS]\n"
+         "       %s fit-nnue FILE OUTPUT [EPOCHS]\n",
+         name, name, name);
+  exit(1);
+}
+
+static int train_threads() {
+  return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+/* run fn(begin, end, thread) over [0, n) split between the threads */
+template <typename F> static void train_parallel(size_t n, F fn) {
+  int num_threads = train_threads();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; t++) {
+    size_t begin = n * t / num_threads, end = n * (t + 1) / num_threads;
+    threads.emplace_back([=]() { fn(begin, end, t); });
+  }
+  for (auto &thread : threads)
+    thread.join();
+}
+
+static void train_play_worker(train_play_t *play) {
+  hash_table_t hash_table;
+  if (!hash_table_alloc(&hash_table, TRAIN_HASH_MB)) {
+    printf("Could not allocate the transposition table\n");
+    exit(1);
+  }
+  // the endgame cutoffs only make the solves faster, the scores are the same
+  search_config_t config = {
+      1,    true, false, play->endgame_empties, false, {0, 0, 0},
+      true, true, false};
+  search_stats_t stats;
+  std::vector<board_t> positions;
+
+  for (int game = play->next_game++; game < play->games;
+       game = play->next_game++) {
+    // each game has its own generator, so the games don't depend on the
+    // number of threads
+    std::mt19937_64 random(play->seed * 0x9e3779b97f4a7c15ull + game);
+    board_t board;
+    memset(&board, 0, sizeof(board));
+    board_set_cell(&board, 27, 0);
+    board_set_cell(&board, 36, 0);
+    board_set_cell(&board, 28, 1);
+    board_set_cell(&board, 35, 1);
+    color_t player = 0;
+    hash_table_clear(&hash_table);
+    positions.clear();
+
+    for (int ply = 0;; ply++) {
+      bitboard_t moves = board_gen_moves(&board, player);
+      if (!moves) {
+        player = !player;
+        moves = board_gen_moves(&board, player);
+        if (!moves)
+          break;
+      }
+      positions.push_back(board);
+
+      move_t move;
+      if (ply < TRAIN_RANDOM_PLIES) {
+        int n = (int)(random() % bits_popcount(moves));
+        move = bitboard_get_and_clear_first_move(&moves);
+        for (int i = 0; i < n; i++)
+          move = bitboard_get_and_clear_first_move(&moves);
+      } else {
+        get_move_depth(&move, &board, player, hash_table, play->depth,
+                       &config, &stats);
+        hash_table_age(&hash_table);
+      }
+      board_make_move(&board, move, player);
+      player = !player;
+    }
+
+    int score =
+        bits_popcount(board.players[0]) - bits_popcount(board.players[1]);
+    std::lock_guard<std::mutex> guard(play->lock);
+    for (auto &position : positions) {
+      fprintf(play->out, "%016llx %016llx %i\n",
+              (unsigned long long)position.players[0],
+              (unsigned long long)position.players[1], score);
+    }
+    play->games_done++;
+    play->positions_done += (long)positions.size();
+    printf("Played %i / %i games (%li positions)    \r", play->games_done,
+           play->games, play->positions_done);
+    fflush(stdout);
+  }
+
+  hash_table_free(&hash_table);
+}
+
+static int train_play(const char *file, int games, int depth,
+                      int endgame_empties, unsigned seed) {
+  train_play_t play;
+  play.out = fopen(file, "a");
+  if (play.out == nullptr) {
+    perror(file);
+    return 1;
+  }
+  play.games = games;
+  play.depth = depth;
+  play.endgame_empties = endgame_empties;
+  play.seed = seed;
+  play.next_game.store(0);
+  play.games_done = 0;
+  play.positions_done = 0;
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < train_threads(); i++)
+    workers.emplace_back(train_play_worker, &play);
+  for (auto &worker : workers)
+    worker.join();
+  printf("\n");
+
+  fclose(play.out);
+  return 0;
+}
+
+/* y = A x: the evaluation of each sample with weights x */
+static void train_multiply(const std::vector<uint32_t> &features,
+                           const std::vector<float> &x,
+                           std::vector<float> *y) {
+  train_parallel(y->size(), [&](size_t begin, size_t end, int) {
+    for (size_t i = begin; i < end; i++) {
+      const uint32_t *sample_features = &features[i * PATTERN_FEATURES];
+      float sum = 0;
+      for (int f = 0; f < PATTERN_FEATURES; f++)
+        sum += x[sample_features[f]];
+      (*y)[i] = sum;
+    }
+  });
+}
+
+/* x = A^T y: each weight's sum of y over the samples that have it */
+static void train_multiply_transposed(const std::vector<uint32_t> &features,
+                                      const std::vector<float> &y,
+                                      std::vector<float> *x) {
+  int num_threads = train_threads();
+  std::vector<std::vector<float>> partial(num_threads);
+  train_parallel(y.size(), [&](size_t begin, size_t end, int t) {
+    partial[t].assign(PATTERN_WEIGHTS, 0.0f);
+    for (size_t i = begin; i < end; i++) {
+      const uint32_t *sample_features = &features[i * PATTERN_FEATURES];
+      for (int f = 0; f < PATTERN_FEATURES; f++)
+        partial[t][sample_features[f]] += y[i];
+    }
+  });
+  train_parallel(PATTERN_WEIGHTS, [&](size_t begin, size_t end, int) {
+    for (size_t w = begin; w < end; w++) {
+      float sum = 0;
+      for (int t = 0; t < num_threads; t++)
+        sum += partial[t][w];
+      (*x)[w] = sum;
+    }
+  });
+}
+
+static double train_dot(const std::vector<float> &a,
+                        const std::vector<float> &b) {
+  double sum = 0;
+  for (size_t i = 0; i < a.size(); i++)
+    sum += (double)a[i] * b[i];
+  return sum;
+}
+
+/* root mean square of the difference between the evaluation of the samples
+ * with weights and their scores, in discs */
+static double train_error(const std::vector<uint32_t> &features,
+                          const std::vector<float> &targets,
+                          const std::vector<float> &weights) {
+  if (targets.empty())
+    return 0.0;
+  std::vector<float> values(targets.size());
+  train_multiply(features, weights, &values);
+  double sum = 0;
+  for (size_t i = 0; i < targets.size(); i++)
+    sum += (double)(values[i] - targets[i]) * (values[i] - targets[i]);
+  return sqrt(sum / targets.size()) / PATTERN_SCALE;
+}
+
+/**
+ * Fit the weights of one phase
+ * Solves min |A w - b|^2 + TRAIN_RIDGE |w - w0|^2 by conjugate gradients on
+ * the normal equations, where each row of A has a 1 for each feature of a
+ * sample, b holds the samples' scores and w0 the starting weights. Only the
+ * canonical weights appear in features, the others stay as they are. */
+static void train_fit_phase(const std::vector<uint32_t> &features,
+                            const std::vector<float> &targets, int iterations,
+                            std::vector<float> *weights) {
+  // solved for the change from the starting weights
+  std::vector<float> residual(targets.size());
+  train_multiply(features, *weights, &residual);
+  for (size_t i = 0; i < targets.size(); i++)
+    residual[i] = targets[i] - residual[i];
+
+  std::vector<float> change(PATTERN_WEIGHTS, 0.0f);
+  std::vector<float> gradient(PATTERN_WEIGHTS);
+  train_multiply_transposed(features, residual, &gradient);
+  std::vector<float> direction = gradient;
+  std::vector<float> step(targets.size());
+  double gamma = train_dot(gradient, gradient);
+
+  for (int iteration = 0; iteration < iterations && gamma > 0; iteration++) {
+    train_multiply(features, direction, &step);
+    double delta =
+        train_dot(step, step) + TRAIN_RIDGE * train_dot(direction, direction);
+    double alpha = gamma / delta;
+    for (int w = 0; w < PATTERN_WEIGHTS; w++)
+      change[w] += (float)alpha * direction[w];
+    for (size_t i = 0; i < targets.size(); i++)
+      residual[i] -= (float)alpha * step[i];
+
+    train_multiply_transposed(features, residual, &gradient);
+    for (int w = 0; w < PATTERN_WEIGHTS; w++)
+      gradient[w] -= (float)TRAIN_RIDGE * change[w];
+    double next_gamma = train_dot(gradient, gradient);
+    double beta = next_gamma / gamma;
+    gamma = next_gamma;
+    for (int w = 0; w < PATTERN_WEIGHTS; w++)
+      direction[w] = gradient[w] + (float)beta * direction[w];
+  }
+
+  for (int w = 0; w < PATTERN_WEIGHTS; w++)
+    (*weights)[w] += change[w];
+}
+
+/* read the samples in file (written by play) to dst
+ * returns false if the file can't be read */
+static bool train_read(const char *file, std::vector<train_sample_t> *dst) {
+  FILE *in = fopen(file, "r");
+  if (in == nullptr) {
+    perror(file);
+    return false;
+  }
+  // the positions of a game are written together, in the order they were
+  // played, so a new game starts wherever the number of pieces doesn't go up
+  int game = -1, last_pieces = 64;
+  char line[256];
+  while (fgets(line, sizeof(line), in) != nullptr) {
+    train_sample_t sample;
+    char *cur = line, *end;
+    sample.board.players[0] = strtoull(cur, &end, 16);
+    if (end == cur)
+      continue;
+    sample.board.players[1] = strtoull(cur = end, &end, 16);
+    sample.score = (int32_t)strtol(cur = end, &end, 10);
+    if (end == cur ||
+        (sample.board.players[0] & sample.board.players[1]) != 0)
+      continue;
+    int pieces =
+        bits_popcount(sample.board.players[0] | sample.board.players[1]);
+    if (pieces <= last_pieces)
+      game++;
+    last_pieces = pieces;
+    sample.game = game;
+    dst->push_back(sample);
+  }
+  fclose(in);
+  printf("%zu samples from %i games\n", dst->size(), game + 1);
+  return true;
+}
+
+static int train_fit(const char *file, const char *output, int iterations) {
+  std::vector<train_sample_t> all_samples;
+  if (!train_read(file, &all_samples))
+    return 1;
+  // by phase
+  std::vector<std::vector<train_sample_t>> samples(PATTERN_PHASES);
+  for (auto &sample : all_samples) {
+    int pieces = bits_popcount(sample.board.players[0] |
+                               sample.board.players[1]);
+    samples[pattern_phase(pieces)].push_back(sample);
+  }
+  std::vector<train_sample_t>().swap(all_samples);
+
+  std::vector<uint32_t> canonical(PATTERN_WEIGHTS);
+  pattern_canonical_indices(canonical.data());
+
+  // each phase starts from the weights of the one before
+  std::vector<float> weights(PATTERN_WEIGHTS, 0.0f);
+  std::vector<int16_t> result(PATTERN_PHASES * PATTERN_WEIGHTS);
+  for (int phase = 0; phase < PATTERN_PHASES; phase++) {
+    // the features (as canonical weights) and scores of the samples, split
+    // into the fitted and validation ones
+    std::vector<train_sample_t> &phase_samples = samples[phase];
+    size_t n = phase_samples.size();
+    std::vector<uint32_t> all_features(n * PATTERN_FEATURES);
+    train_parallel(n, [&](size_t begin, size_t end, int) {
+      for (size_t i = begin; i < end; i++) {
+        board_t *board = &phase_samples[i].board;
+        uint32_t *dst = &all_features[i * PATTERN_FEATURES];
+        pattern_features(board, board_gen_moves(board, 0),
+                         board_gen_moves(board, 1), dst);
+        for (int f = 0; f < PATTERN_FEATURES; f++)
+          dst[f] = canonical[dst[f]];
+      }
+    });
+    std::vector<uint32_t> features, validation_features;
+    std::vector<float> targets, validation_targets;
+    for (size_t i = 0; i < n; i++) {
+      bool validation =
+          phase_samples[i].game % TRAIN_VALIDATION == TRAIN_VALIDATION - 1;
+      auto *dst_features = validation ? &validation_features : &features;
+      auto *dst_targets = validation ? &validation_targets : &targets;
+      dst_features->insert(dst_features->end(),
+                           &all_features[i * PATTERN_FEATURES],
+                           &all_features[(i + 1) * PATTERN_FEATURES]);
+      dst_targets->push_back((float)(phase_samples[i].score * PATTERN_SCALE));
+    }
+    std::vector<uint32_t>().swap(all_features);
+
+    train_fit_phase(features, targets, iterations, &weights);
+    printf("phase %2i: %8zu samples, error %5.2f discs (validation %5.2f)\n",
+           phase, n, train_error(features, targets, weights),
+           train_error(validation_features, validation_targets, weights));
+    fflush(stdout);
+
+    for (int w = 0; w < PATTERN_WEIGHTS; w++) {
+      float weight = std::round(weights[canonical[w]]);
+      result[phase * PATTERN_WEIGHTS + w] =
+          (int16_t)std::max(-32767.0f, std::min(32767.0f, weight));
+    }
+  }
+
+  if (!pattern_save(output, result.data())) {
+    perror(output);
+    return 1;
+  }
+  return 0;
+}
+
+/* --- network training --- */
+
+/* a network as it is trained: the layers of nnue_t, with float weights in
+ * which a clipped value of 1.0 is NNUE_ONE */
+typedef struct {
+  float input_weights[NNUE_INPUTS][NNUE_HIDDEN1];
+  float input_bias[NNUE_HIDDEN1];
+  float hidden_weights[NNUE_HIDDEN2][NNUE_HIDDEN1];
+  float hidden_bias[NNUE_HIDDEN2];
+  float output_weights[NNUE_HIDDEN2];
+  float output_bias;
+} train_net_t;
+
+/* the sums and clipped values of each layer for a board */
+typedef struct {
+  float sum1[NNUE_HIDDEN1], hidden1[NNUE_HIDDEN1];
+  float sum2[NNUE_HIDDEN2], hidden2[NNUE_HIDDEN2];
+} train_activations_t;
+
+/* the network's output for a final disc difference of score */
+static float train_nnue_target(int32_t score) {
+  return (float)score * PATTERN_SCALE / (NNUE_ONE * NNUE_WEIGHT_SCALE);
+}
+
+static void train_nnue_init(train_net_t *net, std::mt19937_64 *random) {
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  // every hidden value starts out between the clipping limits
+  for (int i = 0; i < NNUE_INPUTS; i++)
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      net->input_weights[i][h] = 0.05f * uniform(*random);
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    net->input_bias[h] = 0.5f;
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      net->hidden_weights[j][h] = 0.1f * uniform(*random);
+    net->hidden_bias[j] = 0.5f;
+    net->output_weights[j] = 0.2f * uniform(*random);
+  }
+  net->output_bias = 0.0f;
+}
+
+static float train_clip(float x) { return std::max(0.0f, std::min(1.0f, x)); }
+
+static float train_bound(float x, float bound) {
+  return std::max(-bound, std::min(bound, x));
+}
+
+static float train_nnue_forward(const train_net_t *net, board_t *board,
+                                train_activations_t *act) {
+  memcpy(act->sum1, net->input_bias, sizeof(act->sum1));
+  for (int player = 0; player < 2; player++) {
+    bitboard_t pieces = board->players[player];
+    while (pieces) {
+      const float *row =
+          net->input_weights[player * 64 +
+                             bitboard_get_and_clear_first_move(&pieces)];
+      for (int h = 0; h < NNUE_HIDDEN1; h++)
+        act->sum1[h] += row[h];
+    }
+  }
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    act->hidden1[h] = train_clip(act->sum1[h]);
+
+  float output = net->output_bias;
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    float sum = net->hidden_bias[j];
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      sum += net->hidden_weights[j][h] * act->hidden1[h];
+    act->sum2[j] = sum;
+    act->hidden2[j] = train_clip(sum);
+    output += net->output_weights[j] * act->hidden2[j];
+  }
+  return output;
+}
+
+/* one step of stochastic gradient descent on the squared error of board
+ * returns the error before the step */
+static float train_nnue_step(train_net_t *net, board_t *board, float target,
+                             float rate) {
+  train_activations_t act;
+  float error = train_nnue_forward(net, board, &act) - target;
+
+  // gradients of the hidden values (0 where they are clipped)
+  float gradient2[NNUE_HIDDEN2];
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    bool active = act.sum2[j] > 0.0f && act.sum2[j] < 1.0f;
+    gradient2[j] = active ? error * net->output_weights[j] : 0.0f;
+  }
+  float gradient1[NNUE_HIDDEN1] = {};
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    if (gradient2[j] == 0.0f)
+      continue;
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      gradient1[h] += gradient2[j] * net->hidden_weights[j][h];
+  }
+  for (int h = 0; h < NNUE_HIDDEN1; h++) {
+    if (act.sum1[h] <= 0.0f || act.sum1[h] >= 1.0f)
+      gradient1[h] = 0.0f;
+  }
+
+  // weights are kept within what their quantized types can hold
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    net->output_weights[j] =
+        train_bound(net->output_weights[j] - rate * error * act.hidden2[j],
+                    TRAIN_NNUE_MAX_WEIGHT);
+    if (gradient2[j] == 0.0f)
+      continue;
+    for (int h = 0; h < NNUE_HIDDEN1; h++) {
+      net->hidden_weights[j][h] = train_bound(
+          net->hidden_weights[j][h] - rate * gradient2[j] * act.hidden1[h],
+          TRAIN_NNUE_MAX_WEIGHT);
+    }
+    net->hidden_bias[j] -= rate * gradient2[j];
+  }
+  net->output_bias -= rate * error;
+  for (int player = 0; player < 2; player++) {
+    bitboard_t pieces = board->players[player];
+    while (pieces) {
+      float *row =
+          net->input_weights[player * 64 +
+                             bitboard_get_and_clear_first_move(&pieces)];
+      for (int h = 0; h < NNUE_HIDDEN1; h++)
+        row[h] = train_bound(row[h] - rate * gradient1[h],
+                             TRAIN_NNUE_MAX_INPUT_WEIGHT);
+    }
+  }
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    net->input_bias[h] = train_bound(net->input_bias[h] - rate * gradient1[h],
+                                     TRAIN_NNUE_MAX_INPUT_WEIGHT);
+  return error;
+}
+
+/* round the weights of net to the types and scales of nnue_t */
+static void train_nnue_quantize(const train_net_t *net, nnue_t *dst) {
+  auto quantize = [](float x, float scale) {
+    return (int32_t)std::lround(x * scale);
+  };
+  for (int i = 0; i < NNUE_INPUTS; i++)
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      dst->input_weights[i][h] =
+          (int16_t)quantize(net->input_weights[i][h], NNUE_ONE);
+  for (int h = 0; h < NNUE_HIDDEN1; h++)
+    dst->input_bias[h] = (int16_t)quantize(net->input_bias[h], NNUE_ONE);
+  for (int j = 0; j < NNUE_HIDDEN2; j++) {
+    for (int h = 0; h < NNUE_HIDDEN1; h++)
+      dst->hidden_weights[j][h] =
+          (int8_t)quantize(net->hidden_weights[j][h], NNUE_WEIGHT_SCALE);
+    dst->hidden_bias[j] =
+        quantize(net->hidden_bias[j], NNUE_ONE * NNUE_WEIGHT_SCALE);
+    dst->output_weights[j] =
+        (int8_t)quantize(net->output_weights[j], NNUE_WEIGHT_SCALE);
+  }
+  dst->output_bias = quantize(net->output_bias, NNUE_ONE * NNUE_WEIGHT_SCALE);
+  nnue_prepare(dst);
+}
+
+/* root mean square error of net over the validation samples, in discs, with
+ * the float weights and quantized (as nnue_evaluate) */
+static void train_nnue_error(const train_net_t *net, const nnue_t *quantized,
+                             const std::vector<train_sample_t> &samples,
+                             double *dst_error, double *dst_quantized_error) {
+  double sum = 0, quantized_sum = 0;
+  train_activations_t act;
+  for (auto &sample : samples) {
+    board_t board = sample.board;
+    double error = (train_nnue_forward(net, &board, &act) -
+                    train_nnue_target(sample.score)) *
+                   (NNUE_ONE * NNUE_WEIGHT_SCALE);
+    sum += error * error;
+    nnue_accumulator_t acc;
+    nnue_refresh(quantized, &board, &acc);
+    double quantized_error =
+        nnue_evaluate(quantized, &acc) - sample.score * PATTERN_SCALE;
+    quantized_sum += quantized_error * quantized_error;
+  }
+  size_t n = std::max<size_t>(samples.size(), 1);
+  *dst_error = sqrt(sum / n) / PATTERN_SCALE;
+  *dst_quantized_error = sqrt(quantized_sum / n) / PATTERN_SCALE;
+}
+
+static int train_fit_nnue(const char *file, const char *output, int epochs) {
+  std::vector<train_sample_t> all_samples;
+  if (!train_read(file, &all_samples))
+    return 1;
+  std::vector<train_sample_t> samples, validation;
+  for (size_t i = 0; i < all_samples.size(); i++) {
+    bool is_validation =
+        all_samples[i].game % TRAIN_VALIDATION == TRAIN_VALIDATION - 1;
+    (is_validation ? validation : samples).push_back(all_samples[i]);
+  }
+  std::vector<train_sample_t>().swap(all_samples);
+
+  std::mt19937_64 random(1);
+  train_net_t *net = new train_net_t;
+  train_nnue_init(net, &random);
+  nnue_t *quantized = new nnue_t;
+  std::vector<uint32_t> order(samples.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = (uint32_t)i;
+
+  float rate = TRAIN_NNUE_RATE;
+  for (int epoch = 0; epoch < epochs; epoch++) {
+    std::shuffle(order.begin(), order.end(), random);
+    // the threads update the shared weights without locking (hogwild), the
+    // lost updates hardly matter. Each sample is seen in a random orientation,
+    // and with the players swapped half of the time, which doesn't change
+    // its score (from player 0's point of view) but for the sign
+    unsigned epoch_seed = (unsigned)random();
+    std::vector<double> sums(train_threads(), 0.0);
+    train_parallel(order.size(), [&](size_t begin, size_t end, int t) {
+      std::mt19937 thread_random(epoch_seed + t);
+      for (size_t i = begin; i < end; i++) {
+        const train_sample_t *sample = &samples[order[i]];
+        unsigned r = thread_random();
+        int swap = r & 1;
+        int symmetry = (r >> 1) & 7;
+        board_t board;
+        board.players[0] =
+            bitboard_transform(sample->board.players[swap], symmetry);
+        board.players[1] =
+            bitboard_transform(sample->board.players[!swap], symmetry);
+        float target = train_nnue_target(swap ? -sample->score : sample->score);
+        float error = train_nnue_step(net, &board, target, rate);
+        sums[t] += (double)error * error;
+      }
+    });
+    double sum = 0;
+    for (double thread_sum : sums)
+      sum += thread_sum;
+
+    train_nnue_quantize(net, quantized);
+    double validation_error, quantized_error;
+    train_nnue_error(net, quantized, validation, &validation_error,
+                     &quantized_error);
+    printf("epoch %2i: error %5.2f discs (validation %5.2f, quantized %5.2f)\n",
+           epoch,
+           sqrt(sum / std::max<size_t>(order.size(), 1)) *
+               (NNUE_ONE * NNUE_WEIGHT_SCALE) / PATTERN_SCALE,
+           validation_error, quantized_error);
+    fflush(stdout);
+    rate *= TRAIN_NNUE_RATE_DECAY;
+  }
+
+  bool saved = nnue_save(output, quantized);
+  delete quantized;
+  delete net;
+  if (!saved) {
+    perror(output);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4)
+    print_usage(argv[0]);
+
+  if (strcmp(argv[1], "play") == 0) {
+    int games = (int)strtol(argv[3], nullptr, 10);
+    int depth = argc >= 5 ? (int)strtol(argv[4], nullptr, 10)
+                          : TRAIN_DEFAULT_DEPTH;
+    int empties = argc >= 6 ? (int)strtol(argv[5], nullptr, 10)
+                            : TRAIN_DEFAULT_EMPTIES;
+    unsigned seed = argc >= 7 ? (unsigned)strtoul(argv[6], nullptr, 10) : 1;
+    if (games < 1 || depth < 1 || empties < 0)
+      print_usage(argv[0]);
+    // play with the weights of an earlier fit
+    if (argc >= 8 && !evaluator_load_patterns(argv[7])) {
+      printf("Could not load pattern weights from %s\n", argv[7]);
+      return 1;
+    }
+    return train_play(argv[2], games, depth, empties, seed);
+  } else if (strcmp(argv[1], "fit") == 0) {
+    int iterations = argc >= 5 ? (int)strtol(argv[4], nullptr, 10)
+                               : TRAIN_DEFAULT_ITERATIONS;
+    if (iterations < 1)
+      print_usage(argv[0]);
+    return train_fit(argv[2], argv[3], iterations);
+  } else if (strcmp(argv[1], "fit-nnue") == 0) {
+    int epochs =
+        argc >= 5 ? (int)strtol(argv[4], nullptr, 10) : TRAIN_DEFAULT_EPOCHS;
+    if (epochs < 1)
+      print_usage(argv[0]);
+    return train_fit_nnue(argv[2], argv[3], epochs);
+  }
+  print_usage(argv[0]);
+}